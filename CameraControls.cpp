@@ -0,0 +1,202 @@
+#include "CameraControls.h"
+
+CameraControls::CameraControls()
+{
+	_fd = -1;
+}
+
+//Device controls are sent to
+void CameraControls::set_fd(int fd)
+{
+	_fd = fd;
+	_applied.clear();
+	_rejected.clear();
+
+	//Controls only staged once (i.e. manual exposure) have to reach the new device too
+	for (std::map<uint32_t, int32_t>::iterator it = _requested.begin(); it != _requested.end(); it++)
+	{
+		set(it->first, it->second);
+	}
+}
+
+//Stages a control value
+void CameraControls::set(uint32_t id, int32_t value)
+{
+	_requested[id] = value;
+
+	//Overwrite value if control is already waiting to be applied
+	for (size_t control_ind = 0; control_ind < _pending.size(); control_ind++)
+	{
+		if (_pending[control_ind].id == id)
+		{
+			_pending[control_ind].value = value;
+			return;
+		}
+	}
+
+	//Already set on device
+	std::map<uint32_t, int32_t>::iterator applied = _applied.find(id);
+
+	if (applied != _applied.end() && applied->second == value)
+	{
+		return;
+	}
+
+	//Driver already refused this value, don't retry it every frame
+	std::map<uint32_t, int32_t>::iterator rejected = _rejected.find(id);
+
+	if (rejected != _rejected.end() && rejected->second == value)
+	{
+		return;
+	}
+
+	v4l2_ext_control control;
+	memset(&control, 0, sizeof(control));
+	control.id = id;
+	control.value = value;
+
+	_pending.push_back(control);
+}
+
+//Sends every staged control in one VIDIOC_S_EXT_CTRLS call
+int CameraControls::apply(double &apply_time_ms)
+{
+	apply_time_ms = 0;
+
+	if (_fd < 0 || _pending.empty())
+	{
+		return 0;
+	}
+
+	double apply_timer = cv::getTickCount();
+
+	std::vector<v4l2_ext_control> accepted;
+	std::vector<v4l2_ext_control> rejected;
+
+	//Controls can be mixed across classes with WHICH_CUR_VAL
+	if (_send(_pending, V4L2_CTRL_WHICH_CUR_VAL) == 0)
+	{
+		accepted = _pending;
+	}
+	else
+	{
+		//Older drivers want one class per call, and one bad control fails the whole call, so group by class and still batch within each
+		std::map<uint32_t, std::vector<v4l2_ext_control> > classes;
+
+		for (size_t control_ind = 0; control_ind < _pending.size(); control_ind++)
+		{
+			classes[V4L2_CTRL_ID2CLASS(_pending[control_ind].id)].push_back(_pending[control_ind]);
+		}
+
+		for (std::map<uint32_t, std::vector<v4l2_ext_control> >::iterator it = classes.begin(); it != classes.end(); it++)
+		{
+			_send_class(it->second, it->first, accepted, rejected);
+		}
+	}
+
+	apply_time_ms = 1000 * (cv::getTickCount() - apply_timer) / cv::getTickFrequency();
+
+	//Remember values so they aren't sent again, rejected ones separately so they're retried once they change or on a new device
+	for (size_t control_ind = 0; control_ind < accepted.size(); control_ind++)
+	{
+		_applied[accepted[control_ind].id] = accepted[control_ind].value;
+		_rejected.erase(accepted[control_ind].id);
+	}
+
+	for (size_t control_ind = 0; control_ind < rejected.size(); control_ind++)
+	{
+		_rejected[rejected[control_ind].id] = rejected[control_ind].value;
+	}
+
+	_pending.clear();
+
+	if (rejected.empty() == false)
+	{
+		return -1;
+	}
+
+	return (int)accepted.size();
+}
+
+//Value driver last accepted for a control
+int32_t CameraControls::applied(uint32_t id, int32_t fallback)
+{
+	std::map<uint32_t, int32_t>::iterator applied = _applied.find(id);
+
+	if (applied == _applied.end())
+	{
+		return fallback;
+	}
+
+	return applied->second;
+}
+
+//Sends controls of one class, one at a time if driver rejects them together
+void CameraControls::_send_class(std::vector<v4l2_ext_control> &controls, uint32_t ctrl_class, std::vector<v4l2_ext_control> &accepted, std::vector<v4l2_ext_control> &rejected)
+{
+	if (_send(controls, ctrl_class) == 0)
+	{
+		accepted.insert(accepted.end(), controls.begin(), controls.end());
+		return;
+	}
+
+	//Driver doesn't say reliably how much of a failed call it applied, so send each control again on its own
+	std::string error;
+
+	for (size_t control_ind = 0; control_ind < controls.size(); control_ind++)
+	{
+		std::vector<v4l2_ext_control> single(1, controls[control_ind]);
+
+		if (_send(single, ctrl_class) == 0)
+		{
+			accepted.push_back(controls[control_ind]);
+		}
+		else
+		{
+			rejected.push_back(controls[control_ind]);
+			error = _error;
+		}
+	}
+
+	//Keep error of the control that actually failed, not of the batch
+	if (error.empty() == false)
+	{
+		_error = error;
+	}
+}
+
+//VIDIOC_S_EXT_CTRLS for controls
+int CameraControls::_send(std::vector<v4l2_ext_control> &controls, uint32_t ctrl_class)
+{
+	v4l2_ext_controls ext_controls;
+	memset(&ext_controls, 0, sizeof(ext_controls));
+	ext_controls.which = ctrl_class;
+	ext_controls.count = controls.size();
+	ext_controls.controls = &controls[0];
+
+	int result;
+
+	do
+	{
+		result = ioctl(_fd, VIDIOC_S_EXT_CTRLS, &ext_controls);
+	} while (result == -1 && errno == EINTR);
+
+	if (result < 0)
+	{
+		int error_number = errno;
+
+		//error_idx points at the control driver choked on (or count if it failed before looking at any)
+		_error = "VIDIOC_S_EXT_CTRLS failed: " + std::string(strerror(error_number));
+
+		if (ext_controls.error_idx < controls.size())
+		{
+			char id_str[16];
+			snprintf(id_str, sizeof(id_str), "0x%08x", controls[ext_controls.error_idx].id);
+			_error += " (control " + std::string(id_str) + ")";
+		}
+
+		errno = error_number;
+	}
+
+	return result;
+}
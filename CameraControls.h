@@ -0,0 +1,84 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/videodev2.h>
+
+#include <opencv2/opencv.hpp>
+
+class CameraControls
+{
+public:
+	CameraControls();
+
+	/**
+	 ** @brief Device controls are sent to, -1 to hold changes until a device is open
+	 **
+	 ** Forgets what was applied before and stages every value set so far again, so the new device gets all of them
+	 ***/
+	void set_fd(int fd);
+
+	/**
+	 ** @brief Stages a control value, only sent if it differs from what was last applied (or last rejected)
+	 **
+	 ** @param id V4L2_CID_* of control
+	 ** @param value New value
+	 ***/
+	void set(uint32_t id, int32_t value);
+
+	/**
+	 ** @brief Sends every staged control in one VIDIOC_S_EXT_CTRLS call
+	 **
+	 ** If driver rejects the call, controls are resent a class at a time and then one at a time, so one bad control doesn't lose the rest
+	 **
+	 ** @param apply_time_ms Time the ioctl(s) took
+	 **	@return Number of controls applied, 0 if nothing changed, -1 if driver rejected any
+	 ***/
+	int apply(double &apply_time_ms);
+
+	/**
+	 ** @brief Value driver last accepted for a control
+	 **
+	 ** @param id V4L2_CID_* of control
+	 ** @param fallback Returned if driver hasn't accepted any value for it
+	 ***/
+	int32_t applied(uint32_t id, int32_t fallback);
+
+	/**
+	 ** @brief Description of last failure from apply()
+	 ***/
+	std::string error()
+	{
+		return _error;
+	}
+
+private:
+	int _fd;
+
+	//Controls changed since last apply(), in the order they were set
+	std::vector<v4l2_ext_control> _pending;
+
+	//Value driver last accepted for every control
+	std::map<uint32_t, int32_t> _applied;
+
+	//Value driver last refused for a control, not sent again until it changes
+	std::map<uint32_t, int32_t> _rejected;
+
+	//Newest value set for every control, staged again when device changes
+	std::map<uint32_t, int32_t> _requested;
+
+	std::string _error;
+
+	//VIDIOC_S_EXT_CTRLS for controls, ctrl_class is V4L2_CTRL_WHICH_CUR_VAL or a single control class
+	int _send(std::vector<v4l2_ext_control> &controls, uint32_t ctrl_class);
+
+	//Sends controls of one class, one at a time if driver rejects them together, sorting them into accepted and rejected
+	void _send_class(std::vector<v4l2_ext_control> &controls, uint32_t ctrl_class, std::vector<v4l2_ext_control> &accepted, std::vector<v4l2_ext_control> &rejected);
+};
@@ -0,0 +1,61 @@
+#include "CommandQueue.h"
+
+CommandQueue::CommandQueue()
+{
+	_head = 0;
+	_tail = 0;
+	_dropped = 0;
+}
+
+//Adds command to queue, producer thread only
+bool CommandQueue::push(const Command &command)
+{
+	uint32_t tail = _tail.load(std::memory_order_relaxed);
+
+	//Consumer hasn't caught up, every slot is still holding a command
+	if (tail - _head.load(std::memory_order_acquire) == COMMAND_QUEUE_SIZE)
+	{
+		_dropped++;
+		return false;
+	}
+
+	_commands[tail % COMMAND_QUEUE_SIZE] = command;
+
+	//Publish command to consumer
+	_tail.store(tail + 1, std::memory_order_release);
+
+	return true;
+}
+
+//Takes oldest command, consumer thread only
+bool CommandQueue::pop(Command &command)
+{
+	uint32_t head = _head.load(std::memory_order_relaxed);
+
+	if (head == _tail.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	command = _commands[head % COMMAND_QUEUE_SIZE];
+
+	//Give slot back to producer
+	_head.store(head + 1, std::memory_order_release);
+
+	return true;
+}
+
+//Copies oldest command without taking it, consumer thread only
+bool CommandQueue::peek(Command &command)
+{
+	uint32_t head = _head.load(std::memory_order_relaxed);
+
+	if (head == _tail.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+
+	command = _commands[head % COMMAND_QUEUE_SIZE];
+
+	return true;
+}
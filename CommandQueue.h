@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#define COMMAND_QUEUE_SIZE	16		//Commands that can wait for the main loop before new ones get dropped
+
+//What a command asks the camera to do
+enum
+{
+	COMMAND_BUTTON_1,
+	COMMAND_BUTTON_2
+};
+
+//Timestamped command, i.e. a button press
+struct Command
+{
+	int type;
+	uint32_t tick;		//pigpio tick (us) of the edge
+	double time;		//Time of the edge (seconds, cv::getTickCount() clock)
+};
+
+//Lock-free queue with exactly one producer thread and one consumer thread
+class CommandQueue
+{
+public:
+	CommandQueue();
+
+	/**
+	 ** @brief Adds command to queue, producer thread only, never blocks
+	 **
+	 **	@return false if queue was full and command was dropped
+	 ***/
+	bool push(const Command &command);
+
+	/**
+	 ** @brief Takes oldest command, consumer thread only, never blocks
+	 **
+	 **	@return false if queue is empty
+	 ***/
+	bool pop(Command &command);
+
+	/**
+	 ** @brief Copies oldest command without taking it, consumer thread only, never blocks
+	 **
+	 **	@return false if queue is empty
+	 ***/
+	bool peek(Command &command);
+
+	/**
+	 ** @brief Commands dropped because queue was full
+	 ***/
+	int dropped()
+	{
+		return _dropped;
+	}
+
+private:
+	Command _commands[COMMAND_QUEUE_SIZE];
+
+	//Free-running counters, slot is counter % COMMAND_QUEUE_SIZE
+	std::atomic<uint32_t> _head;	//Next to pop, written by consumer
+	std::atomic<uint32_t> _tail;	//Next to push, written by producer
+
+	std::atomic<int> _dropped;
+};
@@ -0,0 +1,322 @@
+#include "EyeDetector.h"
+
+EyeDetector::EyeDetector()
+{
+	_running = false;
+	_log_buffer.resize(EYE_LOG_BUFFER_SIZE);
+	_log_failed = false;
+	_frames_analysed = 0;
+	_frames_dropped = 0;
+	_frames_stale = 0;
+	_frames_truncated = 0;
+	_detections = 0;
+}
+
+EyeDetector::~EyeDetector()
+{
+	stop();
+}
+
+//Creates log file and starts worker threads
+bool EyeDetector::start(const std::string &log_path, int thread_count)
+{
+	stop();
+
+	//Buffer has to be set before the file is opened to take effect
+	_log.rdbuf()->pubsetbuf(&_log_buffer[0], _log_buffer.size());
+	_log.open(log_path, std::ios::binary | std::ios::trunc);
+
+	if (_log.is_open() == false)
+	{
+		return false;
+	}
+
+	EyeLogHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, EYE_LOG_MAGIC, sizeof(header.magic));
+	header.version = EYE_LOG_VERSION;
+	header.header_size = sizeof(EyeLogHeader);
+	header.frame_size = sizeof(EyeFrameRecord);
+	header.detection_size = sizeof(EyeDetection);
+	header.min_area = EYE_MIN_AREA;
+	header.min_circularity = EYE_MIN_CIRCULARITY;
+
+	_log.write((const char*)&header, sizeof(header));
+
+	_log_failed = _log.fail();
+	_frames_analysed = 0;
+	_frames_dropped = 0;
+	_frames_stale = 0;
+	_frames_truncated = 0;
+	_detections = 0;
+	_process_histogram.reset();
+
+	thread_count = std::max(1, thread_count);
+
+	//One slot per worker plus the queue, frame buffers stay allocated between frames
+	_jobs.resize(thread_count + EYE_QUEUE_SIZE);
+	_free.clear();
+	_queued.clear();
+
+	for (int job_ind = 0; job_ind < (int)_jobs.size(); job_ind++)
+	{
+		_free.push_back(job_ind);
+	}
+
+	_running = true;
+
+	for (int thread_ind = 0; thread_ind < thread_count; thread_ind++)
+	{
+		_threads.push_back(std::thread(&EyeDetector::_detect_eyes_thread, this));
+	}
+
+	return true;
+}
+
+//Finishes queued frames, joins worker threads and closes log
+bool EyeDetector::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+	}
+	_jobs_cv.notify_all();
+
+	for (int thread_ind = 0; thread_ind < (int)_threads.size(); thread_ind++)
+	{
+		_threads[thread_ind].join();
+	}
+
+	_threads.clear();
+
+	if (_log.is_open())
+	{
+		_log.close();
+		_log_failed = _log_failed || _log.fail();
+	}
+
+	return _log_failed == false;
+}
+
+//Copies frame into a free slot for a worker
+bool EyeDetector::submit(const cv::Mat &diff, const cv::Mat &mask, const FrameInfo &info)
+{
+	int job_ind = -1;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_running == false)
+		{
+			return false;
+		}
+
+		if (_free.empty() == false)
+		{
+			job_ind = _free.back();
+			_free.pop_back();
+		}
+	}
+
+	//Workers are behind, frame is logged as dropped so readers can tell it apart from a frame with no eyes
+	if (job_ind < 0)
+	{
+		_write_frame(info, EYE_FRAME_DROPPED, std::vector<EyeDetection>(), 0);
+		return false;
+	}
+
+	//Slot is only ours until it's queued, copy without the lock so workers aren't held up
+	DetectJob &job = _jobs[job_ind];
+	diff.copyTo(job.diff);
+	mask.copyTo(job.mask);
+	job.info = info;
+	job.submit_time = cv::getTickCount() / cv::getTickFrequency();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queued.push_back(job_ind);
+	}
+	_jobs_cv.notify_one();
+
+	return true;
+}
+
+//Frames analysed, dropped, detections and time per frame
+std::string EyeDetector::report()
+{
+	std::lock_guard<std::mutex> lock(_log_mutex);
+	std::stringstream report_ss;
+
+	report_ss << "Eye detector frames: " << _frames_analysed << " analysed (" << _frames_truncated << " cut short), ";
+	report_ss << _frames_dropped << " dropped, " << _frames_stale << " too late\n";
+	report_ss << "Eye detections: " << _detections << "\n";
+	report_ss << _process_histogram.report("Eye detector time");
+
+	return report_ss.str();
+}
+
+//Writes frame record and its detections
+void EyeDetector::_write_frame(const FrameInfo &info, uint32_t flags, const std::vector<EyeDetection> &detections, double process_ms)
+{
+	EyeFrameRecord record;
+	record.index = info.index;
+	record.timestamp = info.timestamp;
+	record.sequence = info.sequence;
+	record.flags = flags;
+	record.detections = detections.size();
+	record.process_ms = process_ms;
+
+	std::lock_guard<std::mutex> lock(_log_mutex);
+
+	if (_log.is_open())
+	{
+		_log.write((const char*)&record, sizeof(record));
+
+		if (detections.empty() == false)
+		{
+			_log.write((const char*)&detections[0], detections.size() * sizeof(EyeDetection));
+		}
+
+		_log_failed = _log_failed || _log.fail();
+	}
+
+	if (flags & EYE_FRAME_DROPPED)
+	{
+		_frames_dropped++;
+	}
+	else if (flags & EYE_FRAME_STALE)
+	{
+		_frames_stale++;
+	}
+	else
+	{
+		_frames_analysed++;
+		_frames_truncated += (flags & EYE_FRAME_TRUNCATED) ? 1 : 0;
+		_detections += detections.size();
+		_process_histogram.record(process_ms);
+	}
+}
+
+//Worker loop
+void EyeDetector::_detect_eyes()
+{
+	cv::Mat labels;
+	cv::Mat stats;
+	cv::Mat centroids;
+	std::vector<EyeDetection> detections;
+
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true)
+	{
+		//Sleep until there's a frame, keep going after stop() until queue is empty
+		_jobs_cv.wait(lock, [this]() { return _queued.empty() == false || _running == false; });
+
+		if (_queued.empty())
+		{
+			break;
+		}
+
+		int job_ind = _queued.front();
+		_queued.pop_front();
+
+		lock.unlock();
+
+		DetectJob &job = _jobs[job_ind];
+		double start_time = cv::getTickCount() / cv::getTickFrequency();
+		double deadline = job.submit_time + EYE_TIME_BUDGET_MS / 1000.0;
+
+		detections.clear();
+
+		//Waited too long for a worker, newer frames are more use than this one
+		if (start_time > deadline)
+		{
+			_write_frame(job.info, EYE_FRAME_STALE, detections, 0);
+		}
+		else
+		{
+			uint32_t flags = 0;
+			int blobs = cv::connectedComponentsWithStats(job.mask, labels, stats, centroids, 8, CV_32S);
+			int channels = job.diff.channels();
+
+			//Label 0 is background
+			for (int label = 1; label < blobs; label++)
+			{
+				if (cv::getTickCount() / cv::getTickFrequency() > deadline)
+				{
+					flags |= EYE_FRAME_TRUNCATED;
+					break;
+				}
+
+				int area = stats.at<int>(label, cv::CC_STAT_AREA);
+
+				if (area < EYE_MIN_AREA || area > EYE_MAX_AREA)
+				{
+					continue;
+				}
+
+				int left = stats.at<int>(label, cv::CC_STAT_LEFT);
+				int top = stats.at<int>(label, cv::CC_STAT_TOP);
+				int width = stats.at<int>(label, cv::CC_STAT_WIDTH);
+				int height = stats.at<int>(label, cv::CC_STAT_HEIGHT);
+
+				//Stats have no perimeter, so roundness is how much of its bounding box's ellipse the blob fills, times how square the box is
+				double fill = area / (CV_PI / 4 * width * height);
+				double circularity = std::min(1.0, fill) * std::min(width, height) / std::max(width, height);
+
+				if (circularity < EYE_MIN_CIRCULARITY)
+				{
+					continue;
+				}
+
+				//Mean of brightest channel's difference over the blob's own pixels, box is small so this is cheap
+				uint64_t intensity_sum = 0;
+
+				for (int row = top; row < top + height; row++)
+				{
+					const int *label_row = labels.ptr<int>(row);
+					const uchar *diff_row = job.diff.ptr(row);
+
+					for (int col = left; col < left + width; col++)
+					{
+						if (label_row[col] != label)
+						{
+							continue;
+						}
+
+						uchar max_diff = 0;
+
+						for (int channel = 0; channel < channels; channel++)
+						{
+							max_diff = std::max(max_diff, diff_row[col * channels + channel]);
+						}
+
+						intensity_sum += max_diff;
+					}
+				}
+
+				EyeDetection detection;
+				detection.x = centroids.at<double>(label, 0);
+				detection.y = centroids.at<double>(label, 1);
+				detection.area = area;
+				detection.intensity = (float)intensity_sum / area;
+				detection.circularity = circularity;
+				detection.width = width;
+				detection.height = height;
+
+				detections.push_back(detection);
+			}
+
+			_write_frame(job.info, flags, detections, 1000 * (cv::getTickCount() / cv::getTickFrequency() - start_time));
+		}
+
+		lock.lock();
+		_free.push_back(job_ind);
+	}
+}
+
+//Start thread for _detect_eyes
+void EyeDetector::_detect_eyes_thread(EyeDetector* ptr)
+{
+	ptr->_detect_eyes();
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameRing.h"
+#include "LatencyHistogram.h"
+
+#define EYE_DETECTOR_THREADS	2		//Worker threads finding blobs
+#define EYE_QUEUE_SIZE			4		//Frames that can wait for a worker before new ones are dropped
+#define EYE_TIME_BUDGET_MS		30.0	//Time a frame gets from being handed over to having its blobs filtered, past it the frame is given up on
+#define EYE_MIN_AREA			4		//Pixels a blob needs to be an eye
+#define EYE_MAX_AREA			400		//Pixels above which a blob is something else lit by the flash
+#define EYE_MIN_CIRCULARITY		0.5		//See EyeDetection::circularity, 1 for a filled circle
+#define EYE_LOG_MAGIC			"FISHEYES"	//First 8 bytes of every detection log
+#define EYE_LOG_VERSION			1			//Bump when record layout changes
+#define EYE_LOG_BUFFER_SIZE		65536		//Bytes buffered before a write hits the file
+
+//Why a frame has no (or only some) detections
+enum
+{
+	EYE_FRAME_DROPPED = 1,		//Every worker was busy, frame was never looked at
+	EYE_FRAME_STALE = 2,		//Waited past the time budget, frame was never looked at
+	EYE_FRAME_TRUNCATED = 4		//Time budget ran out partway through its blobs, remaining blobs were skipped
+};
+
+//Start of detection log, frame records follow straight after it
+struct EyeLogHeader
+{
+	char magic[8];				//EYE_LOG_MAGIC, not null terminated
+	uint32_t version;			//EYE_LOG_VERSION
+	uint32_t header_size;		//sizeof(EyeLogHeader), first frame record starts at this offset
+	uint32_t frame_size;		//sizeof(EyeFrameRecord)
+	uint32_t detection_size;	//sizeof(EyeDetection)
+	uint32_t min_area;			//Filters detections went through
+	float min_circularity;
+};
+
+//One differenced frame, followed by its detections
+//Workers finish frames out of order, so records are in order of completion rather than index. Little-endian, as written by the Pi
+struct EyeFrameRecord
+{
+	uint64_t index;				//Frame ring index of the lit frame
+	double timestamp;			//Capture time of the lit frame (seconds, cv::getTickCount() clock)
+	uint32_t sequence;			//Camera driver's frame counter of the lit frame
+	uint32_t flags;				//EYE_FRAME_*, 0 if every blob was looked at
+	uint32_t detections;		//EyeDetection records following this one
+	float process_ms;			//Time spent finding and filtering blobs
+};
+
+//One blob that passed the size and circularity filters
+struct EyeDetection
+{
+	float x;					//Centroid (pixels)
+	float y;
+	uint32_t area;				//Pixels in blob
+	float intensity;			//Mean flash-minus-ambient difference over blob (brightest channel, 0-255)
+	float circularity;			//Area over area of the ellipse filling its bounding box, times short side over long side
+	uint16_t width;				//Bounding box
+	uint16_t height;
+};
+
+static_assert(sizeof(EyeLogHeader) == 32, "Eye log header layout changed, bump EYE_LOG_VERSION");
+static_assert(sizeof(EyeFrameRecord) == 32, "Eye frame record layout changed, bump EYE_LOG_VERSION");
+static_assert(sizeof(EyeDetection) == 24, "Eye detection layout changed, bump EYE_LOG_VERSION");
+
+//Finds eye reflections in thresholded flash-minus-ambient frames (see FlashDifference) on worker threads and logs them
+//Handing a frame over never waits, frames are dropped from analysis whenever workers fall behind
+class EyeDetector
+{
+public:
+	EyeDetector();
+	~EyeDetector();
+
+	/**
+	 ** @brief Creates log file and starts worker threads
+	 **
+	 ** @param log_path Path of binary detection log
+	 ** @param thread_count Frames worked on at once
+	 **	@return false if log couldn't be created
+	 ***/
+	bool start(const std::string &log_path, int thread_count = EYE_DETECTOR_THREADS);
+
+	/**
+	 ** @brief Finishes frames already handed over, joins workers and closes log
+	 **
+	 **	@return false if any log write failed
+	 ***/
+	bool stop();
+
+	bool is_running()
+	{
+		return _running;
+	}
+
+	/**
+	 ** @brief Copies frame into a free slot for a worker, never waits
+	 **
+	 ** @param diff Flash-minus-ambient difference, 8-bit
+	 ** @param mask Thresholded difference (CV_8UC1, 255 where lit up), same size
+	 ** @param info Info of the lit frame
+	 **	@return false if every slot was busy and frame was dropped
+	 ***/
+	bool submit(const cv::Mat &diff, const cv::Mat &mask, const FrameInfo &info);
+
+	/**
+	 ** @brief Frames analysed, dropped, detections and time per frame, only call after stop()
+	 ***/
+	std::string report();
+
+	/**
+	 ** @brief Time (ms) taken by each analysed frame, only call after stop()
+	 ***/
+	const LatencyHistogram& process_histogram()
+	{
+		return _process_histogram;
+	}
+
+	/**
+	 ** @brief Frames whose blobs were looked at, only call after stop()
+	 ***/
+	int frames_analysed()
+	{
+		return _frames_analysed;
+	}
+
+	/**
+	 ** @brief Frames given up on because workers were behind, dropped on arrival or too late once picked up, only call after stop()
+	 ***/
+	int frames_skipped()
+	{
+		return _frames_dropped + _frames_stale;
+	}
+
+	/**
+	 ** @brief Blobs that passed the filters, only call after stop()
+	 ***/
+	int detections()
+	{
+		return _detections;
+	}
+
+private:
+	struct DetectJob
+	{
+		cv::Mat diff;
+		cv::Mat mask;
+		FrameInfo info;
+		double submit_time;		//Seconds, cv::getTickCount() clock
+	};
+
+	std::vector<std::thread> _threads;
+	bool _running;
+
+	//Preallocated jobs, indexes of free ones and ones waiting for a worker, protected by _mutex
+	std::mutex _mutex;
+	std::condition_variable _jobs_cv;
+	std::vector<DetectJob> _jobs;
+	std::vector<int> _free;
+	std::deque<int> _queued;
+
+	//Log and stats, protected by _log_mutex
+	std::mutex _log_mutex;
+	std::ofstream _log;
+	std::vector<char> _log_buffer;
+	bool _log_failed;
+	int _frames_analysed;
+	int _frames_dropped;
+	int _frames_stale;
+	int _frames_truncated;
+	int _detections;
+	LatencyHistogram _process_histogram;
+
+	//Writes frame record and its detections
+	void _write_frame(const FrameInfo &info, uint32_t flags, const std::vector<EyeDetection> &detections, double process_ms);
+
+	//Worker loop
+	void _detect_eyes();
+
+	//Creates thread for _detect_eyes
+	static void _detect_eyes_thread(EyeDetector* ptr);
+};
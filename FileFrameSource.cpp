@@ -0,0 +1,184 @@
+#include "FileFrameSource.h"
+
+FileFrameSource::FileFrameSource(const std::string &path, double fps, double exposure_time)
+{
+	_path = path;
+	_fps = fps;
+	_exposure_time = exposure_time;
+	_open = false;
+	_image_pos = 0;
+	_sequence = 0;
+	_next_time = 0;
+}
+
+FileFrameSource::~FileFrameSource()
+{
+	close();
+}
+
+//Opens video or lists folder
+bool FileFrameSource::open(cv::Size size)
+{
+	close();
+
+	//Raw video, frames are read from the file without decoding
+	size_t ext_pos = _path.rfind('.');
+	bool raw = (ext_pos != std::string::npos && _path.substr(ext_pos) == RAW_FILE_EXTENSION);
+
+	if (raw)
+	{
+		if (_raw.open(_path) == false)
+		{
+			return false;
+		}
+	}
+
+	//Folder of pictures, i.e. one of the picture folders this program saves
+	else
+	{
+		cv::glob(_path + "/*.jpg", _image_files, false);
+	}
+
+	if (raw == false && _image_files.empty())
+	{
+		if (_video.open(_path) == false)
+		{
+			return false;
+		}
+	}
+
+	_size = size;
+	_image_pos = 0;
+	_sequence = 0;
+	_open = true;
+
+	//Make sure there's at least one readable frame
+	if (_read_next() == false)
+	{
+		close();
+		return false;
+	}
+
+	_next_time = cv::getTickCount() / cv::getTickFrequency();
+
+	return true;
+}
+
+void FileFrameSource::close()
+{
+	_open = false;
+	_image_files.clear();
+	_image.release();
+	_raw.close();
+
+	if (_video.isOpened())
+	{
+		_video.release();
+	}
+}
+
+//Sleeps until next frame is due, then reads it
+bool FileFrameSource::grab(SourceFrame &frame, int timeout_ms)
+{
+	frame.buffer_index = -1;
+
+	if (_open == false)
+	{
+		return false;
+	}
+
+	double now = cv::getTickCount() / cv::getTickFrequency();
+
+	//Not due within the timeout, act like a camera that hasn't delivered yet
+	if (_next_time - now > timeout_ms / 1000.0)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+		return false;
+	}
+
+	if (_next_time > now)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(1000000 * (_next_time - now))));
+	}
+
+	//Frame read at the end of the last grab is handed out now, so file IO isn't counted in its timestamp
+	frame.buffer_index = 0;
+	frame.image = _image;
+	frame.sequence = _sequence++;
+	frame.timestamp = cv::getTickCount() / cv::getTickFrequency();
+	frame.bytes_used = _image.total() * _image.elemSize();
+	frame.flags = 0;
+	//Exposure window modelled like a rolling-shutter camera's, see V4L2Capture::grab()
+	frame.exposure_start = frame.timestamp - _exposure_time - sensor_readout_time(_size.height, _exposure_time, 1.0 / _fps);
+	frame.exposure_end = frame.timestamp;
+
+	//Schedule from when frame was due rather than now, so rate doesn't drift (unless we've fallen a whole frame behind)
+	_next_time = std::max(_next_time + 1.0 / _fps, frame.timestamp);
+
+	return true;
+}
+
+//Copies frame out, resizing if file doesn't match requested size
+bool FileFrameSource::convert(const SourceFrame &frame, cv::Mat &image)
+{
+	if (frame.buffer_index < 0 || frame.image.empty())
+	{
+		return false;
+	}
+
+	if (frame.image.size() == _size)
+	{
+		frame.image.copyTo(image);
+	}
+	else
+	{
+		cv::resize(frame.image, image, _size);
+	}
+
+	return true;
+}
+
+//Reads the frame that the next grab() hands out
+void FileFrameSource::release(SourceFrame &frame)
+{
+	if (frame.buffer_index < 0)
+	{
+		return;
+	}
+
+	frame.image.release();
+	frame.buffer_index = -1;
+
+	_read_next();
+}
+
+//Reads next frame into _image, starting over at the end
+bool FileFrameSource::_read_next()
+{
+	//Header over the mapped frame, so nothing is copied until convert()
+	if (_raw.is_open())
+	{
+		_image = _raw.frame(_image_pos);
+		_image_pos = (_image_pos + 1) % _raw.frames();
+
+		return _image.empty() == false;
+	}
+
+	if (_image_files.empty() == false)
+	{
+		_image = cv::imread(_image_files[_image_pos], cv::IMREAD_COLOR);
+		_image_pos = (_image_pos + 1) % _image_files.size();
+
+		return _image.empty() == false;
+	}
+
+	if (_video.read(_image))
+	{
+		return true;
+	}
+
+	//End of video, loop
+	_video.set(cv::CAP_PROP_POS_FRAMES, 0);
+
+	return _video.read(_image);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameSource.h"
+#include "RawFrameFile.h"
+
+//Replays a recorded video (raw videos straight from the mapped file), or a folder of JPEGs in name order, at a fixed rate and loops at the end
+class FileFrameSource : public FrameSource
+{
+public:
+	/**
+	 ** @param path Video file (RAW_FILE_EXTENSION for raw), or folder holding .jpg files
+	 ** @param fps Rate frames are handed out at
+	 ** @param exposure_time Exposure (seconds) each frame is tagged with
+	 ***/
+	FileFrameSource(const std::string &path, double fps, double exposure_time = 0.01);
+	~FileFrameSource();
+
+	/**
+	 ** @brief Opens video or lists folder, frames are resized to size if they don't match
+	 ***/
+	bool open(cv::Size size);
+
+	void close();
+
+	bool is_open()
+	{
+		return _open;
+	}
+
+	/**
+	 ** @brief Sleeps until next frame is due, then reads it
+	 ***/
+	bool grab(SourceFrame &frame, int timeout_ms);
+
+	bool convert(const SourceFrame &frame, cv::Mat &image);
+
+	void release(SourceFrame &frame);
+
+	cv::Size size()
+	{
+		return _size;
+	}
+
+	void set_exposure_time(double seconds)
+	{
+		_exposure_time = seconds;
+	}
+
+private:
+	std::string _path;
+	double _fps;
+	double _exposure_time;
+	bool _open;
+	cv::Size _size;
+
+	//Video file, raw video, or file names of folder of images
+	cv::VideoCapture _video;
+	RawFrameReader _raw;
+	std::vector<cv::String> _image_files;
+	size_t _image_pos;
+
+	//Frame read from file, handed out by grab()
+	cv::Mat _image;
+
+	uint32_t _sequence;
+
+	//When next frame is due (seconds, cv::getTickCount() clock)
+	double _next_time;
+
+	//Reads next frame into _image, starting over at the end
+	bool _read_next();
+};
@@ -1,10 +1,19 @@
 #include "FishTestCamera.h"
 
 FishTestCamera::FishTestCamera(int flash_leds_pin, int video_led_pin, int success_led_pin, int button_1_pin, int button_2_pin, cv::Size cam_size)
+	: _live_camera(CAMERA_DEVICE, CAMERA_PIXEL_FORMAT, CAMERA_BUFFER_COUNT)
 {
 	//Store cam size into private member
 	_camera_size = cam_size;
 	
+	//Live camera unless told otherwise
+	_camera = &_live_camera;
+	_owned_source = NULL;
+	
+	//Real GPIO unless told otherwise
+	_owned_gpio = NULL;
+	set_gpio_backend(NULL);
+	
 	//Store pins for LEDs
 	_flash_leds_pin = flash_leds_pin;
 	_video_led_pin = video_led_pin;
@@ -14,42 +23,109 @@ FishTestCamera::FishTestCamera(int flash_leds_pin, int video_led_pin, int succes
 	_button_1_pin = button_1_pin;
 	_button_2_pin = button_2_pin;	
 	
+	//Capture thread isn't running until camera is initialized
+	_capture_running = false;
+	_preview_cursor = 0;
+	_record_cursor = 0;
+	_prelude_pending = false;
+	_raw_recording = false;
+	_split_video = false;
+	_difference_video = false;
+	_commands_dropped = 0;
+	
+	//Strobe only runs while recording
+	_strobe_enabled = false;
+	_strobe_mode = LED_STROBE;
+	_strobe_phase_us = 0;
+	_strobe_pulse_failed = false;
+	strobe_reset(_strobe);
+	
 	//Initialize trackbars for cvui
 	cvui::init(CANVAS_NAME);
 }
 
 FishTestCamera::~FishTestCamera()
 {
+	//Stop capture thread and release camera before GPIO goes away
+	_release_cam();
+	
+	//Finish saving pictures and write their logs
+	_image_saver.stop();
+	_finish_pictures();
+	
+	//Stop LED patterns and turn status LEDs off
+	_led_controller.stop();
+	
 	//Terminate GPIO
-	gpioTerminate();
+	_gpio->terminate();
 	
 	//End camera, release any video files
-	if (_video.isOpened())
+	_flash_difference.stop();
+	_eye_detector.stop();
+	_video_encoder.close();
+	_lit_encoder.close();
+	_diff_encoder.close();
+	
+	//Close any remaining windows
+	cv::destroyAllWindows();
+	
+	delete _owned_source;
+	delete _owned_gpio;
+}
+
+//Take frames from source instead of the camera
+void FishTestCamera::set_frame_source(FrameSource *source, cv::Size size)
+{
+	_release_cam();
+	
+	delete _owned_source;
+	_owned_source = source;
+	
+	_camera = (source != NULL) ? source : &_live_camera;
+	
+	if (size.area() > 0)
 	{
-		_video.release();
+		_camera_size = size;
 	}
-	
-	if (_camera.isOpened())
+}
+
+//Drive pins through backend instead of pigpio
+void FishTestCamera::set_gpio_backend(GpioBackend *gpio)
+{
+	delete _owned_gpio;
+	_owned_gpio = gpio;
+	
+#ifdef HAVE_PIGPIO
+	_gpio = (gpio != NULL) ? gpio : &_pigpio;
+#else
+	//Built without pigpio, nothing to fall back on but simulation
+	if (_owned_gpio == NULL)
 	{
-		_camera.release();
+		_owned_gpio = new SimulatedGpio();
 	}
 	
-	//Close any remaining windows
-	cv::destroyAllWindows();
+	_gpio = _owned_gpio;
+#endif
 }
 
 //Initialize dynamic elements
 int FishTestCamera::init()
 {	
 	//Initialize GPIO and return as failure if unsuccessful
-	if (gpioInitialise() < 0) 
+	if (_gpio->initialise() < 0) 
 	{
 		return -1;
 	}
 	
+	//Strobe waves go out through the same backend
+	_strobe_generator.set_gpio(_gpio);
+	
 	//Open video and set height/width
 	_init_cam();
 	
+	//Start picture save workers
+	_image_saver.start();
+	
 	//Get current time for folder
 	string current_time = _get_time();
 	
@@ -60,35 +136,25 @@ int FishTestCamera::init()
 	_file_path_video = _file_path_base + "video/";
 	_file_path_picture = _file_path_base + "pictures/";
 	
-	//Make command for VIDEO directory and then convert it to char
-	string file_command = "mkdir -p " + _file_path_video;
-		
-	//Make directory, return error if not possible
-	if (system(file_command.c_str()) == -1)
+	//Everything created from here on is readable/writable by anyone, so no need to chmod afterwards
+	umask(DATA_UMASK);
+	
+	//Make VIDEO directory, return error if not possible
+	if (_make_dir(_file_path_video) == false)
 	{
 		std::cout << "Failed to make video directory, exiting program\n";
 		return -1;
 	}
 	
-	//Now make command for PICTURE directory and convert it to char
-	file_command = "mkdir -p " + _file_path_picture;
-	
-	//Make directory, return error if not possible
-	if (system(file_command.c_str()) == -1)
+	//Make PICTURE directory, return error if not possible
+	if (_make_dir(_file_path_picture) == false)
 	{
 		std::cout << "Failed to make picture directory, exiting program\n";
 		return -1;
 	}
-		
-	//Now change the two directories to chmod +777	
-	if (system("chmod -R 777 ./") == -1)
-	{
-		std::cout << "Failed to change permissions, exiting program\n";
-		return -1;			
-	}
 	
-	//Set camera to manual exposure
-	system("v4l2-ctl --device /dev/video0 -c auto_exposure=1");	
+	//Set camera to manual exposure, sent with the rest of the settings on first update
+	_camera_controls.set(V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_MANUAL);
 	
 	//Initialize pic and video count
 	_picture_count = 0;
@@ -98,8 +164,12 @@ int FishTestCamera::init()
 	_camera_state = CAMERA_OFF;
 	_picture_state = 0;
 	
-	//Default framerate for video
-	_video_frame_period = FRAME_PERIOD_DEFAULT;
+	//Default strobe phase for video
+	_strobe_phase = STROBE_PHASE_DEFAULT;
+	
+	//Default number of picture pairs per button press
+	_burst_pairs = BURST_PAIRS_DEFAULT;
+	_burst_grabbed = 0;
 
 	//Initialize camera and cvui parameters
 	_exposure = EXPOSURE_DEFAULT;
@@ -110,25 +180,29 @@ int FishTestCamera::init()
 	_blue_balance = BLUE_DEFAULT;
 	_show_cvui = false;
 	
+	//Nothing sent to camera yet
+	_applied_controls = FrameControls();
+	
 	//LED mode when video is playing
 	_video_led_mode = LED_STROBE;
-	
-	//Initialize LED state
-	_led_state = false;
 		
 	//Initialize quit and waitkeys
 	_esc_button = '\0';
 	_esc_key = '\0';
+	_event_pending = false;
 	
 	//LED Pin setup
-	gpioSetMode(_flash_leds_pin, PI_OUTPUT);	
-	gpioSetMode(_video_led_pin, PI_OUTPUT);	
-	gpioSetMode(_success_led_pin, PI_OUTPUT);
+	_gpio->set_mode(_flash_leds_pin, GPIO_OUTPUT);	
+	_gpio->set_mode(_video_led_pin, GPIO_OUTPUT);	
+	_gpio->set_mode(_success_led_pin, GPIO_OUTPUT);
 	
 	//Initialize LEDs
-	gpioWrite(_flash_leds_pin, 0);
-	gpioWrite(_video_led_pin, 0);
-	gpioWrite(_success_led_pin, 0);
+	_gpio->write(_flash_leds_pin, 0);
+	_gpio->write(_video_led_pin, 0);
+	_gpio->write(_success_led_pin, 0);
+	
+	//Start thread that blinks the status LEDs
+	_led_controller.start(_gpio);
 	
 	return 0;
 }
@@ -136,6 +210,12 @@ int FishTestCamera::init()
 //Continuous loop - takes care of organizing camera state machine and running script
 void FishTestCamera::run()
 {
+	//Apply button presses that came in since last pass
+	_process_commands();
+	
+	//Log any pictures that finished saving in the background
+	_finish_pictures();
+	
 	//State machine for camera
 	switch (_camera_state)
 	{
@@ -156,72 +236,176 @@ void FishTestCamera::run()
 	}	
 }
 
-//ISR for button 1 - turn picture mode on
-void FishTestCamera::set_button_1()
+//ISR for button 1 - queues press for main loop, state machine is only touched by main thread
+void FishTestCamera::set_button_1(uint32_t tick)
 {	
-	//If camera is off, turn camera state to picture mode
-	if (_camera_state == CAMERA_OFF)
-	{				
-		//Reset picture state
-		_picture_state = 0;
-		
-		//Turn camera state to picture mode
-		_camera_state = CAMERA_PICTURE;
-	}
+	_button_1_queue.push(_make_command(COMMAND_BUTTON_1, tick));
+	
+	//Don't wait for the next frame to start the picture
+	_notify_event();
 }
 
-//ISR for button 2 - starts timer for run thread to see if button is pressed for 2 seconds
-void FishTestCamera::set_button_2()
+//ISR for button 2 - queues press for main loop, state machine is only touched by main thread
+void FishTestCamera::set_button_2(uint32_t tick)
 {	
-	//If camera state machine is video, can then invoke saving file
-	if (_camera_state == CAMERA_VIDEO)
+	_button_2_queue.push(_make_command(COMMAND_BUTTON_2, tick));
+	
+	//Don't wait for the next frame to start the video
+	_notify_event();
+}
+
+//Makes a command for a button press, with the time the edge actually happened
+Command FishTestCamera::_make_command(int type, uint32_t tick)
+{
+	Command command;
+	
+	command.type = type;
+	command.tick = tick;
+	
+	//Callback can run a little after the edge, so work back from pigpio's tick to when button was actually pressed
+	command.time = cv::getTickCount() / cv::getTickFrequency() - (uint32_t)(_gpio->tick() - tick) / 1000000.0;
+	
+	return command;
+}
+
+//Applies every queued button press to the state machines, in the order they were pressed
+void FishTestCamera::_process_commands()
+{
+	Command command_1;
+	Command command_2;
+	
+	while (true)
 	{
-		std::cout << "Button 2 registered, turning video off\n";
-				
-		//Change video state to tell script to end file, save it, etc.
-		_video_state = VIDEO_DONE;
+		bool has_1 = _button_1_queue.peek(command_1);
+		bool has_2 = _button_2_queue.peek(command_2);
+		
+		if (has_1 == false && has_2 == false)
+		{
+			break;
+		}
+		
+		//Each queue is already in order, so take whichever front is older (tick difference handles the 72 minute wrap)
+		if (has_1 && (has_2 == false || (int32_t)(command_1.tick - command_2.tick) <= 0))
+		{
+			_button_1_queue.pop(command_1);
+			_handle_command(command_1);
+		}
+		else
+		{
+			_button_2_queue.pop(command_2);
+			_handle_command(command_2);
+		}
 	}
+	
+	//Presses that came in while a queue was full never reach the state machines, say so once for each batch lost
+	int commands_dropped = _button_1_queue.dropped() + _button_2_queue.dropped();
+	
+	if (commands_dropped != _commands_dropped)
+	{
+		string warning = "WARNING: " + to_string(commands_dropped - _commands_dropped) + " button presses dropped, command queue was full\n";
+		_file_info_ss << warning;
+		std::cout << warning;
+		
+		_commands_dropped = commands_dropped;
+	}
+}
+
+//Applies one button press to the state machines
+void FishTestCamera::_handle_command(const Command &command)
+{
+	//Button 1 - turn picture mode on
+	if (command.type == COMMAND_BUTTON_1)
+	{
+		//If camera is off, turn camera state to picture mode
+		if (_camera_state == CAMERA_OFF)
+		{				
+			//Time of press, for logging how long it took to get the first frame
+			_button_1_timer = command.time;
+			
+			//Reset picture state
+			_picture_state = 0;
 			
-	//If camera state machine is off, can turn video mode on
-	else if (_camera_state == CAMERA_OFF)
+			//Turn camera state to picture mode
+			_camera_state = CAMERA_PICTURE;
+		}
+	}
+	
+	//Button 2 - toggles video
+	else if (command.type == COMMAND_BUTTON_2)
 	{
-		std::cout << "Button 2 registered, turning video on\n";
-				
-		//Set camera state
-		_camera_state = CAMERA_VIDEO;
+		//If camera state machine is video, can then invoke saving file
+		if (_camera_state == CAMERA_VIDEO)
+		{
+			std::cout << "Button 2 registered, turning video off\n";
+					
+			//Change video state to tell script to end file, save it, etc.
+			_video_state = VIDEO_DONE;
+		}
 				
-		//Set video state to 'record'
-		_video_state = VIDEO_RECORD;
-	}	
+		//If camera state machine is off, can turn video mode on
+		else if (_camera_state == CAMERA_OFF)
+		{
+			std::cout << "Button 2 registered, turning video on\n";
+					
+			//Set camera state
+			_camera_state = CAMERA_VIDEO;
+					
+			//Set video state to 'record'
+			_video_state = VIDEO_RECORD;
+		}	
+	}
 }
 
 //Turn flash on, take picture, turn flash off, take picture, save files
 void FishTestCamera::_camera_off()
 {
 	//Make sure camera is running
-	if (_camera.isOpened() == false)
+	if (_capture_running == false)
 	{
 		//Initiailize camera if need be
 		_init_cam();
 		
-		if (_camera.isOpened() == false)
+		if (_capture_running == false)
 		{
 			return;
 		}
 	}
 	
-	//Make sure cam can be run
-	gpioSleep(PI_TIME_RELATIVE, 0, 5000);
+	//Keep the last few seconds in memory so videos can start before the button was pressed
+	if (_pretrigger.is_running() == false)
+	{
+		_pretrigger.clear();
+		_pretrigger.start(&_frame_ring, PRETRIGGER_SECONDS, PRETRIGGER_MEMORY_BUDGET, PRETRIGGER_JPEG_QUALITY);
+	}
+	
+	//Sleep until capture thread has a new frame or a button is pressed
+	if (_frame_ring.head() == _preview_cursor)
+	{
+		_wait_event(FRAME_WAIT_TIMEOUT);
+	}
 	
-	//Load camera to frame
-	_camera.read(_image);
+	//Button was pressed, go straight to picture/video instead of drawing another preview
+	_process_commands();
+	
+	if (_camera_state != CAMERA_OFF)
+	{
+		return;
+	}
+	
+	//Load newest frame for preview
+	FrameInfo preview_info;
+	
+	if (_frame_ring.read_latest(_preview_cursor, _image, preview_info) == false)
+	{
+		return;
+	}
 	
 	//Adds trackbars for camera settings
 	_add_trackbars();
 	
-	//Show camera for preview
+	//Show camera for preview, waitKey only needs to hand GUI events to cvui since next frame wakes us
 	cv::imshow(CANVAS_NAME, _image);
-	_esc_key = cv::waitKey(10);
+	_esc_key = cv::waitKey(1);
 }
 
 //Records video, once flag has been turned off, save file
@@ -234,18 +418,20 @@ void FishTestCamera::_record_video()
 	_video_timer = cv::getTickCount();
 	
 	//Make sure camera is running
-	if (_camera.isOpened() == false)
+	if (_capture_running == false)
 	{
 		_init_cam();
 		
 		//Still no dice? Record log
-		if (_camera.isOpened() == false)
+		if (_capture_running == false)
 		{
 			_file_info_ss << "Couldn't open video, must return";
 			
 			//Write to log file
 			_write_file(_file_info_ss.str(), _file_path_video + to_string(_video_count) + "_log.txt");
 			
+			_led_controller.show(_success_led_pin, LED_PATTERN_ERROR, ERROR_CODE_CAMERA);
+			
 			return;
 		}
 	}
@@ -254,31 +440,59 @@ void FishTestCamera::_record_video()
 	if (_video_state == 0)
 	{
 		//Turn blue LEDs on
-		gpioWrite(_video_led_pin, 1);		
+		_led_controller.show(_video_led_pin, LED_PATTERN_ON);
 		
-		//Reset frame counter
+		//Reset frame counter and timings
 		_frame_count = 0;
+		_capture_histogram.reset();
+		_display_histogram.reset();
+		_loop_histogram.reset();
+		_led_off_frames = 0;
+		_led_on_frames = 0;
+		_led_mixed_frames = 0;
 		
-		//Load camera to frame
-		_camera.read(_image);
+		//Start recording from the newest frame in the ring
+		_record_cursor = _frame_ring.head();
+		_record_info.index = _record_cursor;
+		_record_info.timestamp = 0;
+		_record_info.sequence = 0;
 		
 		//Store parameters for video
-		string file_name = _file_path_video + to_string(_video_count) + ".avi";
-		int codec = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
 		double fps = 30.0;
-		bool is_color = (_image.type() == CV_8UC3);
 		
-		//Open video stream and record
-		_video.open(file_name, codec, fps, _image.size(), is_color);
+		//Strobed frames alternate between lit and unlit, so each kind gets its own file (at half the rate) and encoder thread
+		_split_video = (_video_led_mode == LED_STROBE || _video_led_mode == LED_PULSE);
+		
+		bool opened;
+		
+		if (_split_video)
+		{
+			opened = _open_video(_video_encoder, VIDEO_UNLIT_SUFFIX, fps / 2, _frame_ring.compressed()) && _open_video(_lit_encoder, VIDEO_LIT_SUFFIX, fps / 2, _frame_ring.compressed());
+			
+			//Difference frames are computed here, so they're always encoded
+			if (opened && _difference_video)
+			{
+				opened = _open_video(_diff_encoder, VIDEO_DIFF_SUFFIX, fps / 2, false);
+			}
+		}
+		else
+		{
+			opened = _open_video(_video_encoder, "", fps, _frame_ring.compressed());
+		}
 		
-		//Ensure video file is open
-		if (!_video.isOpened()) 
+		//Open video file and start encoder thread, make sure it opened
+		if (!opened) 
 		{
+			_video_encoder.close();
+			_lit_encoder.close();
+			_diff_encoder.close();
+			
 			//Write error msg
 			_file_info_ss << "Could not open the output video file for write\n";
 			
 			//Turn blue LEDs off
-			gpioWrite(_video_led_pin, 0);
+			_led_controller.show(_video_led_pin, LED_PATTERN_OFF);
+			_led_controller.show(_success_led_pin, LED_PATTERN_ERROR, ERROR_CODE_FILE);
 			
 			//Write to log file
 			_write_file(_file_info_ss.str(), _file_path_video + to_string(_video_count) + "_log.txt");
@@ -286,49 +500,166 @@ void FishTestCamera::_record_video()
 			return;
 		}
 		
+		//Pre-trigger frames go into the file first, buffer keeps taking live frames until encoder catches up
+		//A split video has them at the start of the unlit file, so strobing waits until the buffer is drained (see below)
+		_prelude_pending = _pretrigger.is_running();
+		
+		if (_prelude_pending)
+		{
+			_file_info_ss << "Pre-trigger footage: " << _pretrigger.buffered_seconds() << "s\n";
+			_pretrigger.reset_stats();
+			_video_encoder.write_prelude(&_pretrigger);
+		}
+		
+		//Capture thread starts switching LEDs as frames arrive, once every frame it captures is routed by LED state
+		_strobe_mode = _video_led_mode;
+		_strobe_phase_us = _strobe_phase * 1000;
+		_strobe_pulse_failed = false;
+		_strobe_enabled = (_split_video == false || _prelude_pending == false);
+		
+		//Eye-shine shows up in the difference of a lit frame and the unlit frame next to it
+		if (_split_video)
+		{
+			_flash_mask.release();
+			
+			//Detection is only logged, recording carries on without it if the log can't be created
+			string eyes_name = _file_path_video + to_string(_video_count) + VIDEO_EYES_SUFFIX;
+			
+			if (_eye_detector.start(eyes_name) == false)
+			{
+				std::cout << "Couldn't create eye log " << eyes_name << ", eyes won't be detected\n";
+			}
+			
+			_flash_difference.start(&_frame_ring, FLASH_DIFF_THRESHOLD, _difference_video ? &_diff_encoder : NULL, _eye_detector.is_running() ? &_eye_detector : NULL);
+		}
+		
 		//Log start of video
-		std::cout << "Writing video " << _video_count << ".avi...\n";		
+		std::cout << "Writing video " << (_split_video ? _video_file_name(VIDEO_LIT_SUFFIX) + " and " + _video_file_name(VIDEO_UNLIT_SUFFIX) : _video_file_name()) << "...\n";		
 	}
 		
 	//Record video and show frames
 	while (_video_state == VIDEO_RECORD && _esc_button != 'q' && _esc_key != 'q')
 	{
-		//Initialize timer for grabbing frame time
-		_frame_timer = cv::getTickCount();
-						
-		//Return if blank frame grabbed
-		if (!_camera.read(_image))
+		double loop_timer = cv::getTickCount();
+		
+		//Once encoder has emptied pre-trigger buffer, carry on from the ring right after its last frame
+		FrameInfo prelude_info;
+		
+		if (_prelude_pending && _video_encoder.prelude_done(prelude_info))
+		{
+			_pretrigger.stop();
+			_prelude_pending = false;
+			
+			if (prelude_info.index != 0)
+			{
+				_record_cursor = prelude_info.index;
+				_record_info = prelude_info;
+			}
+			
+			//Frames from here on are split by LED state, so they can be strobed
+			_strobe_enabled = true;
+		}
+		
+		//Return if capture thread has stopped delivering frames, only pace on preview while pre-trigger frames are written
+		if (!_frame_ring.wait(_prelude_pending ? _preview_cursor : _record_cursor, FRAME_WAIT_TIMEOUT))
 		{
 			_file_info_ss << "WARNING: Grabbed blank frame, ending video...\n";
 			
 			break;
 		}
 		
-		//Capture frame
-		_video.write(_image);	
+		//Write every frame captured since last pass, so a slow GUI never costs recorded frames
+		uint64_t prev_index = _record_info.index;
+		uint32_t prev_sequence = _record_info.sequence;
+		double prev_timestamp = _record_info.timestamp;
 		
-		//Toggle led state for strobing
-		_led_state = !_led_state;
-	
-		//Strobe lights, or just keep them on/off depending on desired video mode
-		switch (_video_led_mode)
+		while (_prelude_pending == false && _read_record_frame())
 		{
-		case LED_OFF:
-			gpioWrite(_flash_leds_pin, 0);
-			break;
-		case LED_STROBE:
-			gpioWrite(_flash_leds_pin, _led_state);
-			break;
-		case LED_ON:
-			gpioWrite(_flash_leds_pin, 1);
-			break;
-		default:
-			gpioWrite(_flash_leds_pin, _led_state);
-			break;
+			//Log frames the recorder was too slow to pick up before the ring overwrote them
+			if (_record_info.index != prev_index + 1)
+			{
+				_file_info_ss << "WARNING: " << _record_info.index - prev_index - 1 << " frames dropped before frame " << _frame_count + 1 << "\n";
+			}
+			
+			//Driver sequence tells us about frames lost before they ever reached the ring
+			if (_frame_count > 0 && _record_info.sequence - prev_sequence > _record_info.index - prev_index)
+			{
+				_file_info_ss << "WARNING: camera skipped " << _record_info.sequence - prev_sequence - (_record_info.index - prev_index) << " frames before frame " << _frame_count + 1 << "\n";
+			}
+			
+			//Split video goes by LED state actually in effect, frames lit for only part of the exposure are left out of both files
+			VideoEncoder *encoder = &_video_encoder;
+			
+			if (_split_video && _record_info.led_state == 1)
+			{
+				encoder = &_lit_encoder;
+			}
+			else if (_split_video && _record_info.led_state != 0)
+			{
+				encoder = NULL;
+			}
+			
+			//Hand frame to encoder thread, it counts the frame as dropped if its queue is full
+			if (encoder != NULL && _frame_ring.compressed())
+			{
+				encoder->push_compressed(_record_data, _record_info);
+			}
+			else if (encoder != NULL)
+			{
+				encoder->push(_record_image, _record_info);
+			}
+			
+			//Increment frame count, get time between camera frames
+			_frame_count++;
+			
+			if (_frame_count > 1)
+			{
+				_frame_timer = 1000 * (_record_info.timestamp - prev_timestamp);
+				_capture_histogram.record(_frame_timer);
+			}
+			
+			//Count frames by LED state instead of logging each one
+			if (_record_info.led_state == 1)
+			{
+				_led_on_frames++;
+			}
+			else if (_record_info.led_state == 0)
+			{
+				_led_off_frames++;
+			}
+			else
+			{
+				_led_mixed_frames++;
+			}
+			
+			prev_index = _record_info.index;
+			prev_sequence = _record_info.sequence;
+			prev_timestamp = _record_info.timestamp;
 		}
+		
+		double display_timer = cv::getTickCount();
+		
+		//Load newest frame for preview, independently of what recorder has consumed
+		FrameInfo preview_info;
+		_frame_ring.read_latest(_preview_cursor, _image, preview_info);
+		
+		//Highlight what lit up between last lit and unlit frames
+		if (_flash_difference.is_running())
+		{
+			_flash_difference.latest_mask(_flash_mask);
 			
+			if (_flash_mask.size() == _image.size())
+			{
+				_image.setTo(cv::Scalar(0, 255, 255), _flash_mask);
+			}
+		}
+		
 		//Adds trackbars for camera settings
 		_add_trackbars();
+		
+		//Pass on any strobe changes from the settings window
+		_strobe_mode = _video_led_mode;
+		_strobe_phase_us = _strobe_phase * 1000;
 			
 		//Draw red rectangle around frame, also say recording
 		cv::rectangle(_image, cv::Point(1, 1), cv::Point(_image.size().width - 1, _image.size().height - 1), cv::Scalar(0, 0, 255), 3);
@@ -337,17 +668,81 @@ void FishTestCamera::_record_video()
 		//Show live while recording
 		cv::imshow(CANVAS_NAME, _image);
 		
-		//Delay so LED flash can be fully on or off in the shot (not in transition)
-		_esc_key = cv::waitKey(_video_frame_period);		
+		//LEDs follow the camera now, so only wait long enough to handle GUI events
+		_esc_key = cv::waitKey(1);
+		
+		_display_histogram.record(1000 * (cv::getTickCount() - display_timer) / cv::getTickFrequency());
 		
-		//Increment frame count, get time, write to log
-		_frame_count++;
-		_file_info_ss << "Frame " << _frame_count << " time: " << round(1000*(cv::getTickCount() - _frame_timer) / cv::getTickFrequency()) << "ms \n";		
+		//Button 2 may have been pressed to end the video
+		_process_commands();
+		
+		_loop_histogram.record(1000 * (cv::getTickCount() - loop_timer) / cv::getTickFrequency());
 	}
+	
+	//Capture thread switches flash LEDs off on the next frame
+	_strobe_enabled = false;
+		
+	//Stopped before encoder caught up, it still writes whatever is buffered
+	if (_prelude_pending)
+	{
+		_pretrigger.stop();
+		_prelude_pending = false;
+	}
+	
+	//Difference thread pushes to its encoder and eye detector, so it stops first
+	bool differenced = _flash_difference.is_running();
+	_flash_difference.stop();
+	
+	bool detected = _eye_detector.is_running();
+	bool eyes_logged = _eye_detector.stop();
+	
+	//Let encoders finish queued frames and save files, camera keeps streaming into the ring for preview
+	_video_encoder.close();
+	_lit_encoder.close();
+	_diff_encoder.close();
+	
+	//Frame timing percentiles, encode latency, queue depth and dropped frames
+	_file_info_ss << "Frames recorded: " << _frame_count << "\n";
+	_file_info_ss << _capture_histogram.report("Time between frames");
+	_file_info_ss << _display_histogram.report("Preview time");
+	_file_info_ss << _loop_histogram.report("Recorder loop time");
+	
+	if (_split_video)
+	{
+		_file_info_ss << "Unlit video " << _video_file_name(VIDEO_UNLIT_SUFFIX) << ":\n" << _video_encoder.report();
+		_file_info_ss << "Lit video " << _video_file_name(VIDEO_LIT_SUFFIX) << ":\n" << _lit_encoder.report();
+		_file_info_ss << "Frames in neither video (LEDs switched during exposure): " << _led_mixed_frames << " of " << _frame_count << "\n";
 		
-	//Save video file to file
-	_video.release();
-	_camera.release();
+		//Exposure plus readout that fills the frame period leaves no frame clean, the split files end up with little or nothing in them
+		if (_led_mixed_frames > _led_on_frames + _led_off_frames)
+		{
+			string warning = "WARNING: most strobed frames were exposed across an LED switch, lower exposure or frame rate (or change strobe phase) to get lit and unlit frames\n";
+			_file_info_ss << warning;
+			std::cout << warning;
+		}
+	}
+	
+	if (differenced)
+	{
+		_file_info_ss << _flash_difference.report();
+	}
+	
+	if (detected)
+	{
+		_file_info_ss << "Eye log " << to_string(_video_count) << VIDEO_EYES_SUFFIX << (eyes_logged ? ":\n" : " (write failed):\n") << _eye_detector.report();
+	}
+	
+	if (differenced && _difference_video)
+	{
+		_file_info_ss << "Difference video " << _video_file_name(VIDEO_DIFF_SUFFIX) << ":\n" << _diff_encoder.report();
+	}
+	
+	if (_split_video == false)
+	{
+		_file_info_ss << _video_encoder.report();
+	}
+	
+	_file_info_ss << "Pre-trigger frames evicted before encoder caught up: " << _pretrigger.evicted() << "\n";
 	
 	//Write remaining file info
 	_file_info_ss << "Exposure of camera: " << _exposure << "\n";
@@ -356,9 +751,30 @@ void FishTestCamera::_record_video()
 	_file_info_ss << "Saturation of camera: " << _saturation << "\n";
 	_file_info_ss << "Red balance of camera: " << _red_balance << "\n";
 	_file_info_ss << "Blue balance of camera: " << _blue_balance << "\n";
-	_file_info_ss << "Video frame period: " << _video_frame_period << "\n";
-	_file_info_ss << "LED Strobe mode (0 for off, 1 for strobe, 2 for on): " << _video_led_mode << "\n";
-	_file_info_ss << "File " << _video_count << ".avi successfully saved to " << _file_path_video << "\n";
+	_file_info_ss << "Strobe phase offset: " << _strobe_phase << "ms\n";
+	_file_info_ss << "LED Strobe mode (0 for off, 1 for strobe, 2 for on, 3 for pulse): " << _video_led_mode << "\n";
+	
+	if (_video_led_mode == LED_PULSE)
+	{
+		_file_info_ss << "Strobe pulse width: " << STROBE_PULSE_WIDTH << "us, pattern: " << STROBE_PULSE_PATTERN << ", pulses skipped (previous still running): " << _strobe_generator.overruns() << "\n";
+		
+		if (_strobe_pulse_failed)
+		{
+			_file_info_ss << "Strobe pulses couldn't be built or sent by pigpio, LEDs were switched directly every frame instead (software timed)\n";
+		}
+	}
+	
+	_file_info_ss << "Frames with LEDs on: " << _led_on_frames << ", off: " << _led_off_frames << ", switched during exposure: " << _led_mixed_frames << (_split_video ? " (left out of split video)" : "") << "\n";
+	
+	if (_split_video)
+	{
+		_file_info_ss << "Files " << _video_file_name(VIDEO_LIT_SUFFIX) << " and " << _video_file_name(VIDEO_UNLIT_SUFFIX) << " successfully saved to " << _file_path_video << "\n";
+	}
+	else
+	{
+		_file_info_ss << "File " << _video_file_name() << " successfully saved to " << _file_path_video << "\n";
+	}
+	
 	_file_info_ss << "Length of video: " << (cv::getTickCount() - _video_timer) / cv::getTickFrequency() << "s\n";
 	_file_info_ss << "Date and time of video record: " << _get_time() << "\n\n";
 
@@ -366,14 +782,10 @@ void FishTestCamera::_record_video()
 	_write_file(_file_info_ss.str(), _file_path_video + to_string(_video_count) + "_log.txt");
 	
 	//Video is done recording, so can turn blue LEDs off
-	gpioWrite(_video_led_pin, 0);	
-		
-	//Make sure flash LEDs are off
-	_led_state = 0;
-	gpioWrite(_flash_leds_pin, _led_state);
+	_led_controller.show(_video_led_pin, LED_PATTERN_OFF);
 	
-	//Turn success LEDs on (calls thread)
-	_call_show_success();
+	//Blink success LEDs
+	_led_controller.show(_success_led_pin, LED_PATTERN_SUCCESS);
 	
 	//Reset camera state
 	_camera_state = CAMERA_OFF;	
@@ -385,100 +797,150 @@ void FishTestCamera::_record_video()
 	_video_count++;		
 }
 
+//Reads next frame for recorder from ring
+bool FishTestCamera::_read_record_frame()
+{
+	if (_frame_ring.compressed())
+	{
+		return _frame_ring.read_compressed(_record_cursor, _record_data, _record_info);
+	}
+	
+	return _frame_ring.read(_record_cursor, _record_image, _record_info);
+}
+
 //Turn flash on, take picture, turn flash off, take picture, save files
 void FishTestCamera::_record_pictures()
 {
 	//Record current directory for creating and then saving pics to
 	string curr_file_path = _file_path_picture + to_string(_picture_count) + "/";
 	
-	//Take picture with flash off and save
+	//Grab unlit frame
 	if (_picture_state == 0)
 	{
-		//Release camera if need be
-		if (_camera.isOpened() == true)
-		{
-			_camera.release();	
-		}
-		
-		//Open camera
-		_init_cam();
-		
 		//Clear stringstream for taking in file data
 		_file_info_ss.str("");
 		
-		//Make directory
-		string make_dir_command = "mkdir -p " + curr_file_path;
+		//Camera keeps streaming between pictures, only open it if preview never did
+		_init_cam();
+		
+		//Make room for every pair up front, buffers only get reallocated if burst grew or camera size changed
+		if ((int)_burst_off_images.size() < _burst_pairs)
+		{
+			_burst_off_images.resize(_burst_pairs);
+			_burst_on_images.resize(_burst_pairs);
+			_burst_off_info.resize(_burst_pairs);
+			_burst_on_info.resize(_burst_pairs);
+			_burst_led_on_time.resize(_burst_pairs);
+			_burst_discarded.resize(_burst_pairs);
+		}
 		
-		//Make C version of string so unix can use
-		char *make_dir_command_char;		
-		make_dir_command_char = (char*) malloc(make_dir_command.size() + 1);
-	
-		//Dump C++ string into C string
-		for (int char_ind = 0; char_ind < make_dir_command.size(); char_ind++)
+		for (int pair_ind = 0; pair_ind < _burst_pairs; pair_ind++)
 		{
-			make_dir_command_char[char_ind] = make_dir_command[char_ind];
+			_burst_off_images[pair_ind].create(_frame_ring.size(), _frame_ring.type());
+			_burst_on_images[pair_ind].create(_frame_ring.size(), _frame_ring.type());
 		}
-		make_dir_command_char[make_dir_command.size()] = '\0';
 		
-		//Make directory
-		system(make_dir_command_char);
+		_switch_image.create(_frame_ring.size(), _frame_ring.type());
+		_burst_extra_image.create(_frame_ring.size(), _frame_ring.type());
 		
-		//Sleep 1ms
-		gpioSleep(PI_TIME_RELATIVE, 0, 1000);
+		//Grab first frame captured after the button press before anything else so it's as close to the press as possible
+		_picture_cursor = _frame_ring.head();
 		
-		//Take picture and save
-		if (_camera.read(_image)) 
-		{			
-			cv::imwrite(curr_file_path + to_string(_picture_count) + "_flash_off.jpg", _image);		
+		if (_frame_ring.wait(_picture_cursor, FRAME_WAIT_TIMEOUT) && _frame_ring.read(_picture_cursor, _burst_off_images[0], _burst_off_info[0]))
+		{
+			_file_info_ss << "Button to first frame latency: " << round(1000 * (_burst_off_info[0].timestamp - _button_1_timer)) << "ms (frame ready after " << round(1000 * (cv::getTickCount() / cv::getTickFrequency() - _button_1_timer)) << "ms)\n";
 			
-			_file_info_ss << "Image: " << _picture_count << "_flash_off.jpg successfully saved to " << curr_file_path << " at " << _get_time() << "\n";		
+			//Advance state machine
+			_picture_state++;
 		}
 		else
 		{
-			_file_info_ss << "Error: Image: " << _picture_count << "_flash_off.jpg could not be saved to " << curr_file_path << " at " << _get_time() << "\n";
+			_file_info_ss << "Error: no frame from camera for image " << _picture_count << "\n";
+			
+			//Skip straight to saving log
+			_picture_state = 2;
 		}
 		
-		//Advance state machine
-		_picture_state++;
-		
-		//Turn LEDs on
-		gpioWrite(_flash_leds_pin, 1);
-		
-		//Reset picture timer
-		_picture_timer = cv::getTickCount();
-		
+		//Make directory, unlit frames that arrive meanwhile just replace the one we have
+		if (_make_dir(curr_file_path) == false)
+		{
+			_file_info_ss << "Error: could not make directory " << curr_file_path << "\n";
+		}
 	}
 	
-	//Take picture with flash on and save
+	//Alternate LEDs on and off for every pair, frames stay in preallocated buffers until burst is over
 	if (_picture_state == 1)
-	{				
-		//Sleep 1ms
-		gpioSleep(PI_TIME_RELATIVE, 0, 1000);
+	{
+		double burst_timer = cv::getTickCount();
+		_burst_grabbed = 0;
 		
-		//Add time for buffering
-		for (int capture_count = 0; capture_count < 1; capture_count++)
+		for (int pair_ind = 0; pair_ind < _burst_pairs; pair_ind++)
 		{
-			_camera.read(_image);		
+			//Turn LEDs on, keep newest unlit frame and first fully lit one
+			if (_capture_flash_switch(1, _picture_cursor, _burst_off_images[pair_ind], _burst_off_info[pair_ind], _burst_on_images[pair_ind], _burst_on_info[pair_ind], _burst_led_on_time[pair_ind], _burst_discarded[pair_ind]) == false)
+			{
+				break;
+			}
+			
+			_burst_grabbed++;
 			
-			//Sleep 1ms
-			gpioSleep(PI_TIME_RELATIVE, 0, 1000);
+			//Turn LEDs off for next pair's unlit frame, lit frames after the first one aren't kept
+			if (pair_ind + 1 < _burst_pairs)
+			{
+				double led_off_time;
+				int discarded;
+				
+				if (_capture_flash_switch(0, _picture_cursor, _burst_extra_image, _burst_extra_info, _burst_off_images[pair_ind + 1], _burst_off_info[pair_ind + 1], led_off_time, discarded) == false)
+				{
+					break;
+				}
+			}
+		}
+		
+		//Done with the flash
+		_gpio->write(_flash_leds_pin, 0);
+		
+		double burst_time = (cv::getTickCount() - burst_timer) / cv::getTickFrequency();
+		
+		//Hand every frame to the save workers now that timing no longer matters, their results get logged as they finish
+		for (int pair_ind = 0; pair_ind < _burst_grabbed; pair_ind++)
+		{
+			_image_saver.save(_picture_count, curr_file_path, _burst_file_name(pair_ind, false), _burst_off_images[pair_ind]);
+			_image_saver.save(_picture_count, curr_file_path, _burst_file_name(pair_ind, true), _burst_on_images[pair_ind]);
 		}
 		
-		//Take picture and save
-		if (_camera.read(_image)) 
-		{			
-			cv::imwrite(curr_file_path + to_string(_picture_count) + "_flash_on.jpg", _image);
+		//Per-pair timing, all relative to when LEDs turned on for that pair
+		for (int pair_ind = 0; pair_ind < _burst_grabbed; pair_ind++)
+		{
+			double led_on_time = _burst_led_on_time[pair_ind];
 			
-			_file_info_ss << "Image: " << _picture_count << "_flash_on.jpg successfully saved to " << curr_file_path << " at " << _get_time() << "\n";		
+			_file_info_ss << "Pair " << pair_ind << ":\n";
+			_file_info_ss << "Flash off frame: exposure ended " << round(1000 * (led_on_time - _burst_off_info[pair_ind].exposure_end)) << "ms before LEDs turned on\n";
+			_file_info_ss << "Flash on frame: exposure started " << round(1000 * (_burst_on_info[pair_ind].exposure_start - led_on_time)) << "ms after LEDs turned on, " << _burst_discarded[pair_ind] << " partially lit frames skipped\n";
+			
+			//Write time between the two shots
+			_file_info_ss << "Time distance between camera shots: " << _burst_on_info[pair_ind].timestamp - _burst_off_info[pair_ind].timestamp << "\n";
+			
+			if (pair_ind > 0)
+			{
+				_file_info_ss << "Time since previous pair: " << round(1000 * (_burst_on_info[pair_ind].timestamp - _burst_on_info[pair_ind - 1].timestamp)) << "ms\n";
+			}
 		}
-		else
+		
+		if (_burst_grabbed < _burst_pairs)
 		{
-			_file_info_ss << "Error: Image: " << _picture_count << "_flash_on.jpg could not be saved to " << curr_file_path << " at " << _get_time() << "\n";
+			_file_info_ss << "Error: only " << _burst_grabbed << " of " << _burst_pairs << " pairs captured, camera stopped delivering frames\n";
 		}
 		
-		//Write time it between shots
-		_file_info_ss << "Time distance between camera shots: " <<  (cv::getTickCount() - _picture_timer) / cv::getTickFrequency() << "\n\n";
+		_file_info_ss << "\nBurst of " << _burst_grabbed << " pairs captured in " << round(1000 * burst_time) << "ms at " << _get_time() << "\n\n";
 		
+		//Advance state machine
+		_picture_state++;
+	}
+	
+	//Save log and go back to preview
+	if (_picture_state == 2)
+	{				
 		//Write other camera parameters
 		_file_info_ss << "Exposure of camera: " << _exposure << "\n";
 		_file_info_ss << "Brightness of camera: " << _brightness << "\n";
@@ -487,14 +949,16 @@ void FishTestCamera::_record_pictures()
 		_file_info_ss << "Red balance of camera: " << _red_balance << "\n";
 		_file_info_ss << "Blue balance of camera: " << _blue_balance << "\n";
 		
-		//Write it to display, and save it to file as well
-		std::cout << _file_info_ss.str();
-		_write_file(_file_info_ss.str(), curr_file_path + to_string(_picture_count) + "_log.txt");
-		
-		//Change permission on all to 777
-		system("chmod -R 777 ./");
+		//Log gets written once save workers are done with this picture's images
+		PendingPicture pending;
+		pending.picture_count = _picture_count;
+		pending.path = curr_file_path;
+		pending.log = _file_info_ss.str() + "Save results:\n";
+		pending.remaining = 2 * _burst_grabbed;
+		pending.error_code = (_burst_grabbed < _burst_pairs) ? ERROR_CODE_CAMERA : 0;
+		_pending_pictures.push_back(pending);
 			
-		//Reset state machines so it can exit picture mode
+		//Reset state machines so it can exit picture mode, preview carries on while images are saved
 		_picture_state++;
 		_camera_state = CAMERA_OFF;
 		
@@ -502,33 +966,412 @@ void FishTestCamera::_record_pictures()
 		_picture_count++;
 		
 		//Turn LEDs off
-		gpioWrite(_flash_leds_pin, 0);
-				
-		//Turn success LEDs on (calls thread)
-		_call_show_success();
+		_gpio->write(_flash_leds_pin, 0);
+	}
+}
+
+//Wakes main loop
+void FishTestCamera::_notify_event()
+{
+	{
+		std::lock_guard<std::mutex> lock(_event_mutex);
+		_event_pending = true;
+	}
+	_event_cv.notify_one();
+}
+
+//Sleeps until _notify_event() is called or timeout runs out
+bool FishTestCamera::_wait_event(int timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(_event_mutex);
+	
+	bool notified = _event_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return _event_pending; });
+	_event_pending = false;
+	
+	return notified;
+}
+
+//Adds finished saves to their picture logs, writes a log once all its images are saved
+void FishTestCamera::_finish_pictures()
+{
+	SaveResult result;
+	
+	while (_image_saver.pop_result(result))
+	{
+		for (int pending_ind = 0; pending_ind < (int)_pending_pictures.size(); pending_ind++)
+		{
+			PendingPicture &pending = _pending_pictures[pending_ind];
+			
+			if (pending.picture_count != result.group)
+			{
+				continue;
+			}
+			
+			stringstream result_ss;
+			
+			if (result.saved)
+			{
+				result_ss << "Image: " << result.file_name << " successfully saved to " << pending.path << " (encode " << round(result.encode_time) << "ms, write " << round(result.write_time) << "ms)\n";
+			}
+			else
+			{
+				result_ss << "Error: Image: " << result.file_name << " could not be saved to " << pending.path << "\n";
+				pending.error_code = ERROR_CODE_FILE;
+			}
+			
+			pending.log += result_ss.str();
+			pending.remaining--;
+			
+			break;
+		}
+	}
+	
+	//Write out every picture that has all its images saved
+	while (_pending_pictures.empty() == false && _pending_pictures.front().remaining <= 0)
+	{
+		PendingPicture &pending = _pending_pictures.front();
 		
-		//Release camera
-		_camera.release();	
+		pending.log += "Saves finished at " + _get_time() + "\n";
+		
+		//Write it to display, and save it to file as well
+		std::cout << pending.log;
+		_write_file(pending.log, pending.path + to_string(pending.picture_count) + "_log.txt");
+		
+		//Blink success LEDs, or error code if any frame or file went missing
+		if (pending.error_code == 0)
+		{
+			_led_controller.show(_success_led_pin, LED_PATTERN_SUCCESS);
+		}
+		else
+		{
+			_led_controller.show(_success_led_pin, LED_PATTERN_ERROR, pending.error_code);
+		}
 		
-		//Re-initializes camera
-		_init_cam();		
+		_pending_pictures.pop_front();
 	}
 }
 
-//Makes sure camera is initialized/turned on, sets width/height
+//Makes sure camera is initialized/turned on, sets width/height, starts capture thread
 void FishTestCamera::_init_cam()
 {
-	//Set up video stream
-	if (_camera.isOpened() == false)
+	//Capture thread already owns a running camera
+	if (_capture_running == true)
+	{
+		return;
+	}
+	
+	//Set up video stream with width/height, driver may pick a different size
+	if (_camera->is_open() == false)
+	{
+		if (_camera->open(_camera_size) == false)
+		{
+			return;
+		}
+	}
+	
+	//MJPEG is kept compressed in the ring (a JPEG is never bigger than the raw frame), everything else is converted to BGR
+	size_t compressed_bytes = _camera->compressed() ? _camera->size().area() * 3 : 0;
+	
+	//Only reallocate ring if camera format changed
+	if (_frame_ring.empty() || _frame_ring.size() != _camera->size() || _frame_ring.type() != CV_8UC3 || _frame_ring.compressed() != (compressed_bytes > 0))
+	{
+		_frame_ring.init(FRAME_RING_SIZE, _camera->size(), CV_8UC3, compressed_bytes);
+		_preview_cursor = 0;
+		_record_cursor = 0;
+	}
+	
+	//Controls go to the newly opened device, all current settings get resent on next update
+	_camera_controls.set_fd(_camera->fd());
+	
+	//Start capture thread
+	_capture_running = true;
+	_capture_thread = thread(&FishTestCamera::_capture_frames_thread, this);
+}
+
+//Stops capture thread and releases camera
+void FishTestCamera::_release_cam()
+{
+	//Pre-trigger worker reads the ring, stop it before the ring can be reallocated
+	_pretrigger.stop();
+	
+	//Let capture thread finish its current read
+	_capture_running = false;
+	
+	if (_capture_thread.joinable())
+	{
+		_capture_thread.join();
+	}
+	
+	//Don't leave flash LEDs on if capture stopped mid-strobe
+	if (_strobe.pulsing)
+	{
+		_strobe.pulsing = false;
+		_strobe_generator.stop();
+	}
+	
+	if (_strobe.level != 0)
+	{
+		_strobe.level = 0;
+		_gpio->write(_flash_leds_pin, 0);
+	}
+	
+	_camera->close();
+	
+	//Hold setting changes until camera is reopened
+	_camera_controls.set_fd(-1);
+}
+
+//Capture thread loop - only reads frames into ring, never waits on GUI or file IO
+void FishTestCamera::_capture_frames()
+{
+	SourceFrame frame;
+	FrameInfo info;
+	
+	while (_capture_running)
+	{
+		//Dequeue kernel buffer, consumers time out on the ring and report a blank frame if this keeps failing
+		if (_camera->grab(frame, CAPTURE_POLL_TIMEOUT) == false)
+		{
+			continue;
+		}
+		
+		//Tag frame with what the LEDs were doing while it was exposed, before switching them for the next one
+		info.led_state = strobe_state_during(_strobe, frame.exposure_start, frame.exposure_end);
+		
+		int strobe_phase_us = _strobe_phase_us;
+		bool strobe_pulsed = (_strobe_enabled && _strobe_mode == LED_PULSE && _strobe_pulse_failed == false);
+		
+		//No phase offset (or pulse delay is timed by hardware), switch LEDs for next frame straight away
+		if (strobe_pulsed || strobe_phase_us == 0)
+		{
+			_update_strobe();
+		}
+		
+		info.timestamp = frame.timestamp;
+		info.sequence = frame.sequence;
+		info.exposure_start = frame.exposure_start;
+		info.exposure_end = frame.exposure_end;
+		
+		{
+			std::lock_guard<std::mutex> lock(_controls_mutex);
+			info.controls = _applied_controls;
+		}
+		info.controls.strobe_mode = _strobe_enabled ? (int)_strobe_mode : LED_OFF;
+		info.controls.strobe_phase_us = strobe_phase_us;
+		
+		bool published;
+		
+		//Compressed frames go into the ring as they are, only consumers that need pixels decode them
+		if (_frame_ring.compressed())
+		{
+			published = _frame_ring.publish_compressed(frame.image.data, frame.image.total(), info);
+			_camera->release(frame);
+		}
+		
+		//Convert straight from kernel buffer into the preallocated ring slot, then hand buffer back
+		else
+		{
+			bool converted = _camera->convert(frame, _frame_ring.write_slot());
+			_camera->release(frame);
+			
+			published = converted && _frame_ring.publish(info);
+		}
+		
+		if (published)
+		{
+			_notify_event();
+		}
+		
+		//Wait out the rest of the phase offset (measured from frame's timestamp), then switch LEDs
+		if (strobe_pulsed == false && strobe_phase_us > 0)
+		{
+			double strobe_delay = frame.timestamp + strobe_phase_us / 1000000.0 - cv::getTickCount() / cv::getTickFrequency();
+			
+			if (strobe_delay > 0)
+			{
+				_gpio->delay((uint32_t)(strobe_delay * 1000000));
+			}
+			
+			_update_strobe();
+		}
+	}
+}
+
+//Start thread for _capture_frames
+void FishTestCamera::_capture_frames_thread(FishTestCamera* ptr)
+{
+	ptr->_capture_frames();
+}
+
+//Capture thread - switches flash LEDs for the next frame according to strobe mode
+void FishTestCamera::_update_strobe()
+{
+	int level;
+	
+	//Pulse mode - wave delays by the phase offset and times the pulse itself
+	//Out of control blocks, pigpio not running or a backend without waves leaves LEDs dark, so strobe the pin directly instead (below)
+	if (_strobe_enabled && _strobe_mode == LED_PULSE && _strobe_pulse_failed == false)
+	{
+		if (_strobe_generator.configure(_flash_leds_pin, STROBE_PULSE_WIDTH, _strobe_phase_us, STROBE_PULSE_PATTERN) == false)
+		{
+			_strobe_pulse_failed = true;
+		}
+		else
+		{
+			//Coming from strobe/on mode, LEDs have to start off
+			if (_strobe.pulsing == false)
+			{
+				_strobe.pulsing = true;
+				_strobe_generator.reset_pattern();
+				
+				if (_strobe.level != 0)
+				{
+					_strobe.level = 0;
+					_gpio->write(_flash_leds_pin, 0);
+				}
+			}
+			
+			_strobe_generator.trigger(cv::getTickCount() / cv::getTickFrequency(), _strobe.pulse_start, _strobe.pulse_end);
+			
+			if (_strobe_generator.send_failures() == 0)
+			{
+				return;
+			}
+			
+			_strobe_pulse_failed = true;
+		}
+	}
+	
+	//Left pulse mode, free wave and make sure pin is low
+	if (_strobe.pulsing)
+	{
+		_strobe.pulsing = false;
+		_strobe_generator.stop();
+	}
+	
+	if (_strobe_enabled == false)
+	{
+		//Not recording, turn LEDs off if strobe left them on, otherwise leave them to picture mode
+		level = 0;
+	}
+	else
+	{
+		switch (_strobe_mode)
+		{
+		case LED_OFF:
+			level = 0;
+			break;
+		case LED_ON:
+			level = 1;
+			break;
+		case LED_STROBE:
+		case LED_PULSE:		//Only if pulses failed
+		default:
+			level = !_strobe.level;
+			break;
+		}
+	}
+	
+	//Only write pin and note the time on an actual change
+	if (level != _strobe.level)
+	{
+		_gpio->write(_flash_leds_pin, level);
+		
+		strobe_switched(_strobe, level, cv::getTickCount() / cv::getTickFrequency());
+	}
+}
+
+//Switches flash LEDs, then picks newest frame fully exposed before the switch and first frame fully exposed after it
+bool FishTestCamera::_capture_flash_switch(int led_level, uint64_t &cursor, cv::Mat &before_image, FrameInfo &before_info, cv::Mat &after_image, FrameInfo &after_info, double &switch_time, int &discarded)
+{
+	discarded = 0;
+	
+	//Switch LEDs and note when they actually changed
+	_gpio->write(_flash_leds_pin, led_level);
+	switch_time = cv::getTickCount() / cv::getTickFrequency();
+	
+	//Go through every frame since before_image, in order, until one started exposing after the switch
+	double wait_timer = cv::getTickCount();
+	
+	while ((cv::getTickCount() - wait_timer) / cv::getTickFrequency() < FRAME_WAIT_TIMEOUT / 1000.0)
+	{
+		if (_frame_ring.wait(cursor, FRAME_WAIT_TIMEOUT) == false)
+		{
+			return false;
+		}
+		
+		FrameInfo info;
+		
+		while (_frame_ring.read(cursor, _switch_image, info))
+		{
+			//Fully exposed after switch, done
+			if (info.exposure_start >= switch_time)
+			{
+				cv::swap(after_image, _switch_image);
+				after_info = info;
+				
+				return true;
+			}
+			
+			//Fully exposed before switch, it's a closer 'before' frame than what we had
+			if (info.exposure_end <= switch_time)
+			{
+				cv::swap(before_image, _switch_image);
+				before_info = info;
+			}
+			
+			//Exposure straddles the switch, partially lit
+			else
+			{
+				discarded++;
+			}
+		}
+	}
+	
+	return false;
+}
+
+//File name of one image in a burst, pair number is left out if burst is a single pair
+string FishTestCamera::_burst_file_name(int pair_ind, bool flash_on)
+{
+	string file_name = to_string(_picture_count);
+	
+	if (_burst_pairs > 1)
 	{
-		_camera.open(0);	
-		gpioSleep(PI_TIME_RELATIVE, 0, 1000);
+		file_name += "_" + to_string(pair_ind);
 	}
 	
-	//Set video stream width/height
-	_camera.set(cv::CAP_PROP_FRAME_WIDTH, _camera_size.width);
-	_camera.set(cv::CAP_PROP_FRAME_HEIGHT, _camera_size.height);
+	return file_name + (flash_on ? "_flash_on" : "_flash_off") + (_raw_recording ? RAW_PICTURE_EXTENSION : ".jpg");
+}
+
+//File name of current video, extension depends on recording mode
+string FishTestCamera::_video_file_name(const string &suffix)
+{
+	return to_string(_video_count) + suffix + (_raw_recording ? RAW_FILE_EXTENSION : ".avi");
+}
+
+//Opens encoder for one file of current video, with its sidecar
+bool FishTestCamera::_open_video(VideoEncoder &encoder, const string &suffix, double fps, bool compressed)
+{
+	string file_name = _file_path_video + _video_file_name(suffix);
+	int codec = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+	bool is_color = (_frame_ring.type() == CV_8UC3);
+	
+	//Per-frame metadata for analysis scripts, one fixed-size record per video frame
+	string sidecar_name = _file_path_video + to_string(_video_count) + suffix + "_frames.bin";
+	
+	//Raw keeps every pixel, camera's JPEGs are decoded on the encoder thread. Otherwise, if camera already compressed the frames, write them as they are instead of decoding and re-encoding
+	if (_raw_recording)
+	{
+		return encoder.open_raw(file_name, fps, _frame_ring.size(), _frame_ring.type(), compressed, sidecar_name);
+	}
 	
+	if (compressed)
+	{
+		return encoder.open_passthrough(file_name, fps, _frame_ring.size(), sidecar_name);
+	}
+	
+	return encoder.open(file_name, codec, fps, _frame_ring.size(), is_color, sidecar_name);
 }
 
 //Adds trackbars for certain parameters to be adjusted
@@ -605,8 +1448,8 @@ void FishTestCamera::_add_trackbars()
 		update_window_pos.y += TRACKBAR_VERTICAL_SPACE;
 		
 		//Change framerate of video
-		cvui::trackbar(_image, update_window_pos.x + 10, update_window_pos.y, 180, &_video_frame_period, FRAME_PERIOD_MIN, FRAME_PERIOD_MAX);
-		cvui::text(_image, update_window_pos.x + 60, update_window_pos.y, "Frame period");		
+		cvui::trackbar(_image, update_window_pos.x + 10, update_window_pos.y, 180, &_strobe_phase, STROBE_PHASE_MIN, STROBE_PHASE_MAX);
+		cvui::text(_image, update_window_pos.x + 55, update_window_pos.y, "Strobe phase (ms)");		
 
 		//Put in buttons for picture and video
 		update_window_pos.y = height - 75;
@@ -624,6 +1467,9 @@ void FishTestCamera::_add_trackbars()
 		case LED_ON:
 			led_mode_string = "LED is on";
 			break;
+		case LED_PULSE:
+			led_mode_string = "LED is pulsed";
+			break;
 		default:
 			break;
 		}
@@ -634,7 +1480,7 @@ void FishTestCamera::_add_trackbars()
 			_video_led_mode++;
 			
 			//Roll over if video led mode variable has exceeded max
-			if (_video_led_mode >= 3)
+			if (_video_led_mode >= LED_MODE_COUNT)
 			{
 				_video_led_mode = 0;
 			}
@@ -643,8 +1489,11 @@ void FishTestCamera::_add_trackbars()
 		//Default values
 		if (cvui::button(_image, update_window_pos.x+100, update_window_pos.y, 100, 25, "Default Values")) 
 		{
-			//Default framerate for video
-			_video_frame_period = FRAME_PERIOD_DEFAULT;
+			//Default strobe phase for video
+			_strobe_phase = STROBE_PHASE_DEFAULT;
+			
+			//Default number of picture pairs per button press
+			_burst_pairs = BURST_PAIRS_DEFAULT;
 
 			//Initialize camera and cvui parameters
 			_exposure = EXPOSURE_DEFAULT;
@@ -653,7 +1502,12 @@ void FishTestCamera::_add_trackbars()
 			_saturation = SATURATION_DEFAULT;
 			_red_balance = RED_DEFAULT;
 			_blue_balance = BLUE_DEFAULT;
-		}		
+		}
+		
+		//Number of flash off/on pairs taken per picture button press
+		cvui::text(_image, update_window_pos.x + 10, height - 20, "Burst pairs");
+		cvui::counter(_image, update_window_pos.x + 100, height - 25, &_burst_pairs);
+		_burst_pairs = std::max(BURST_PAIRS_MIN, std::min(BURST_PAIRS_MAX, _burst_pairs));
 	}	
 		
 	//Put in buttons for picture and video
@@ -662,15 +1516,15 @@ void FishTestCamera::_add_trackbars()
 	//Take picture button
 	if (cvui::button(_image, update_window_pos.x, update_window_pos.y, 100, 25, "Picture")) 
 	{
-		//Essentially, this is like pressing button 1
-		set_button_1();
+		//Essentially, this is like pressing button 1, already on main thread so no need to queue it
+		_handle_command(_make_command(COMMAND_BUTTON_1, _gpio->tick()));
 	}	
 		
 	//Take picture button
 	if (cvui::button(_image, update_window_pos.x + 100, update_window_pos.y, 100, 25, "Video")) 
 	{
-		//Essentially, this is like pressing button 2
-		set_button_2();
+		//Essentially, this is like pressing button 2, already on main thread so no need to queue it
+		_handle_command(_make_command(COMMAND_BUTTON_2, _gpio->tick()));
 	}
 	
 	//Add quit window
@@ -689,64 +1543,43 @@ void FishTestCamera::_add_trackbars()
 //Updates camera settings based on trackbar input
 void FishTestCamera::_update_camera_settings()
 {
-	//Only do this if exposure has been changed
-	if (_exposure_prev != _exposure) 
+	//Stage every setting, only the ones that changed since last time get sent
+	_camera_controls.set(V4L2_CID_EXPOSURE_ABSOLUTE, _exposure);
+	_camera_controls.set(V4L2_CID_BRIGHTNESS, _brightness);
+	_camera_controls.set(V4L2_CID_CONTRAST, _contrast);
+	_camera_controls.set(V4L2_CID_SATURATION, _saturation);
+	_camera_controls.set(V4L2_CID_RED_BALANCE, _red_balance);
+	_camera_controls.set(V4L2_CID_BLUE_BALANCE, _blue_balance);
+	
+	//Apply all changes in one ioctl
+	double apply_time;
+	int control_count = _camera_controls.apply(apply_time);
+	
+	//Frames from here on are tagged with the settings driver accepted, a rejected one keeps its last good value
+	if (control_count != 0)
 	{
-		_exposure_prev = _exposure;
-
-		//Update exposure
-		string exposure_command = "v4l2-ctl --device /dev/video0 -c exposure_time_absolute=" + to_string(_exposure);
-		system(exposure_command.c_str());		
-	}
-	
-	//Only do this if brightness has been changed
-	if (_brightness_prev != _brightness) 
-	{
-		_brightness_prev = _brightness;
-
-		//Update brightness
-		string brightness_command = "v4l2-ctl --device /dev/video0 -c brightness=" + to_string(_brightness);
-		system(brightness_command.c_str());		
-	}
-	
-	//Only do this if contrast has been changed
-	if (_contrast_prev != _contrast) 
-	{
-		_contrast_prev = _contrast;
-
-		//Update contrast
-		string contrast_command = "v4l2-ctl --device /dev/video0 -c contrast=" + to_string(_contrast);
-		system(contrast_command.c_str());		
+		std::lock_guard<std::mutex> lock(_controls_mutex);
+		_applied_controls.exposure = _camera_controls.applied(V4L2_CID_EXPOSURE_ABSOLUTE, _applied_controls.exposure);
+		_applied_controls.brightness = _camera_controls.applied(V4L2_CID_BRIGHTNESS, _applied_controls.brightness);
+		_applied_controls.contrast = _camera_controls.applied(V4L2_CID_CONTRAST, _applied_controls.contrast);
+		_applied_controls.saturation = _camera_controls.applied(V4L2_CID_SATURATION, _applied_controls.saturation);
+		_applied_controls.red_balance = _camera_controls.applied(V4L2_CID_RED_BALANCE, _applied_controls.red_balance);
+		_applied_controls.blue_balance = _camera_controls.applied(V4L2_CID_BLUE_BALANCE, _applied_controls.blue_balance);
+		
+		//Capture uses exposure time to work out when each frame was exposed, it keeps its own until driver has taken one
+		if (_applied_controls.exposure > 0)
+		{
+			_camera->set_exposure_time(_applied_controls.exposure * EXPOSURE_UNIT);
+		}
 	}
 	
-	//Only do this if saturation has been changed
-	if (_saturation_prev != _saturation) 
+	if (control_count > 0)
 	{
-		_saturation_prev = _saturation;
-
-		//Update saturation
-		string saturation_command = "v4l2-ctl --device /dev/video0 -c saturation=" + to_string(_saturation);
-		system(saturation_command.c_str());		
+		std::cout << "Updated " << control_count << " camera settings in " << apply_time << "ms\n";
 	}
-	
-	//Only do this if red balance has been changed
-	if (_red_balance_prev != _red_balance) 
+	else if (control_count < 0)
 	{
-		_red_balance_prev = _red_balance;
-
-		//Update red balance
-		string red_balance_command = "v4l2-ctl --device /dev/video0 -c red_balance=" + to_string(_red_balance);
-		system(red_balance_command.c_str());		
-	}
-	
-	//Only do this if blue balance has been changed
-	if (_blue_balance_prev != _blue_balance) 
-	{
-		_blue_balance_prev = _blue_balance;
-
-		//Update blue balance
-		string blue_balance_command = "v4l2-ctl --device /dev/video0 -c blue_balance=" + to_string(_blue_balance);
-		system(blue_balance_command.c_str());		
+		std::cout << "Failed to update camera settings: " << _camera_controls.error() << " (" << apply_time << "ms)\n";
 	}
 }
 
@@ -820,29 +1653,23 @@ void FishTestCamera::_write_file(string input, string path)
 	out_file.close();
 }
 
-//Flash green LED to show that video or picture has been successful
-void FishTestCamera::_show_success()
-{
-	//Flash thrice
-	gpioWrite(_success_led_pin, 1);
-	gpioSleep(PI_TIME_RELATIVE, 0, 500000);
-	gpioWrite(_success_led_pin, 0);
-	gpioSleep(PI_TIME_RELATIVE, 0, 500000);	
-	gpioWrite(_success_led_pin, 1);
-	gpioSleep(PI_TIME_RELATIVE, 0, 500000);
-	gpioWrite(_success_led_pin, 0);
-}
-
-//Start thread for show_success
-void FishTestCamera::_show_success_thread(FishTestCamera* ptr)
-{
-	ptr->_show_success();
-}
-
-//Function invoked to actually start the thread
-void FishTestCamera::_call_show_success()
+//Makes folder and any missing parent folders, without going through a shell
+bool FishTestCamera::_make_dir(string path)
 {
-	//Tell program it's success
-	thread t1(&FishTestCamera::_show_success_thread, this);
-	t1.detach();
+	//Make each folder along the path in turn, like mkdir -p
+	for (size_t slash_pos = path.find('/', 1); slash_pos != string::npos; slash_pos = path.find('/', slash_pos + 1))
+	{
+		if (mkdir(path.substr(0, slash_pos).c_str(), DATA_DIR_MODE) != 0 && errno != EEXIST)
+		{
+			return false;
+		}
+	}
+	
+	//Path may not end in '/'
+	if (mkdir(path.c_str(), DATA_DIR_MODE) != 0 && errno != EEXIST)
+	{
+		return false;
+	}
+	
+	return true;
 }
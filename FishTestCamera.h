@@ -8,13 +8,41 @@
 #include <sstream>
 #include <cstdlib>
 #include <fstream>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cerrno>
+
+#include <sys/stat.h>
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/imgcodecs.hpp>
 
 #include "cvui.h"
 
-#include <pigpio.h>
+#include "FrameRing.h"
+#include "VideoEncoder.h"
+#include "PreTriggerBuffer.h"
+#include "FrameSource.h"
+#include "V4L2Capture.h"
+#include "CameraControls.h"
+#include "StrobeGenerator.h"
+#include "StrobeState.h"
+#include "ImageSaver.h"
+#include "CommandQueue.h"
+#include "LedController.h"
+#include "GpioBackend.h"
+#include "LatencyHistogram.h"
+#include "SimulatedGpio.h"
+#include "RawFrameFile.h"
+#include "FlashDifference.h"
+#include "EyeDetector.h"
+
+//Set by CMake when pigpio is found, otherwise GPIO can only be simulated
+#ifdef HAVE_PIGPIO
+#include "PigpioBackend.h"
+#endif
 
 using namespace std;
 
@@ -23,6 +51,7 @@ using namespace std;
 #define EXPOSURE_DEFAULT	100		//Default exposure of camera
 #define EXPOSURE_MIN		20		//Min exposure of camera
 #define EXPOSURE_MAX		250		//Max exposure of camera
+#define EXPOSURE_UNIT		0.0001	//Seconds per step of exposure (exposure_time_absolute is in 100us)
 
 #define BRIGHTNESS_DEFAULT	50		//Default brightness of camera
 #define BRIGHTNESS_MIN		0		//Min brightness of camera
@@ -44,12 +73,46 @@ using namespace std;
 #define BLUE_MIN			1		//min value for blue balance of camera
 #define BLUE_MAX			7999	//Max value for blue balance of camera
 
-#define FRAME_PERIOD_DEFAULT 30		//Default frame rate
-#define FRAME_PERIOD_MIN	5		//Minimum framerate for video
-#define FRAME_PERIOD_MAX	60		//Max framerate for video
+#define STROBE_PHASE_DEFAULT 0		//Default delay (ms) from a frame arriving to switching LEDs for the next frame
+#define STROBE_PHASE_MIN	0		//Min strobe phase offset
+#define STROBE_PHASE_MAX	30		//Max strobe phase offset
+
+#define STROBE_PULSE_WIDTH	2000	//Length (us) of each hardware-timed flash pulse in LED_PULSE mode
+#define STROBE_PULSE_PATTERN "10"	//Which frames get a pulse ('1' fires, '0' skips), repeats
+
+#define DATA_DIR_MODE		0777	//Permissions of new data folders, so anyone can copy data off the Pi
+#define DATA_UMASK			0000	//Umask while running, so new files come out 0666 and folders DATA_DIR_MODE
+
+#define ERROR_CODE_CAMERA	2		//Success LED blinks this many times if camera gave no frames
+#define ERROR_CODE_FILE		3		//Success LED blinks this many times if a file couldn't be written
+
+#define BURST_PAIRS_DEFAULT	1		//Default number of flash off/on pairs per picture button press
+#define BURST_PAIRS_MIN		1		//Min pairs per burst
+#define BURST_PAIRS_MAX		10		//Max pairs per burst, each pair holds two full frames in memory
 
 #define TRACKBAR_VERTICAL_SPACE 70	//Distance between trackbars in cvui menu bar
 
+#define CAMERA_DEVICE		"/dev/video0"		//V4L2 device of camera
+#define CAMERA_PIXEL_FORMAT	V4L2_PIX_FMT_MJPEG	//Format requested from the driver, MJPEG is recorded without re-encoding (YUYV still works, frames get encoded)
+#define CAMERA_BUFFER_COUNT	V4L2_BUFFER_COUNT	//Number of mmap'd kernel buffers
+#define CAPTURE_POLL_TIMEOUT 100	//Time (ms) capture thread waits on driver before checking if it should stop
+
+#define FRAME_RING_SIZE		8		//Number of preallocated frames shared between capture thread and consumers
+#define FRAME_WAIT_TIMEOUT	1000	//Time (ms) to wait on capture thread before assuming camera has stalled
+
+#define PRETRIGGER_SECONDS	3.0		//Seconds of footage from before the video button that start each video
+#define PRETRIGGER_MEMORY_BUDGET (64 * 1024 * 1024)	//Max bytes of compressed pre-trigger frames kept in memory
+#define PRETRIGGER_JPEG_QUALITY	90	//JPEG quality of pre-trigger frames
+
+#define RAW_PICTURE_EXTENSION	".png"	//Format of pictures in raw recording mode, lossless (extension picks ImageSaver's encoder)
+
+#define VIDEO_LIT_SUFFIX	"_lit"		//Strobed videos are split by LED state into N_lit and N_unlit files
+#define VIDEO_UNLIT_SUFFIX	"_unlit"
+#define VIDEO_DIFF_SUFFIX	"_diff"		//Flash-minus-ambient difference of a split video, when turned on
+#define VIDEO_EYES_SUFFIX	"_eyes.bin"	//Eye reflections found in a split video's differences, see EyeDetector.h
+
+#define FLASH_DIFF_THRESHOLD	40		//Lit minus unlit difference (0-255) that gets a pixel highlighted in the preview, 0 turns highlight off
+
 //State of class, either taking a picture or running a video
 enum
 {
@@ -68,7 +131,9 @@ enum
 {
 	LED_OFF,
 	LED_STROBE,
-	LED_ON
+	LED_ON,
+	LED_PULSE,
+	LED_MODE_COUNT
 };
 
 class FishTestCamera
@@ -100,14 +165,61 @@ public:
 	void run();
 	
 	/**
-	 ** @brief Set button 1 to on
+	 ** @brief Queue button 1 press, only call from button 1's pigpio callback thread
+	 **
+	 ** @param tick pigpio tick of the debounced edge
+	 ***/
+	void set_button_1(uint32_t tick);
+	
+	/**
+	 ** @brief Queue button 2 press, only call from button 2's pigpio callback thread
+	 **
+	 ** @param tick pigpio tick of the debounced edge
+	 ***/
+	void set_button_2(uint32_t tick);
+	
+	/**
+	 ** @brief Take frames from source instead of the camera, i.e. recorded footage or synthetic frames for benchmarking
+	 **
+	 ** @param source Takes ownership, call before init()
+	 ** @param size Frame size to ask source for, empty keeps size given to constructor
+	 ***/
+	void set_frame_source(FrameSource *source, cv::Size size = cv::Size());
+	
+	/**
+	 ** @brief Drive pins through another GPIO backend, i.e. SimulatedGpio to run without a Pi
+	 **
+	 ** @param gpio Takes ownership, NULL for pigpio (SimulatedGpio if built without pigpio), call before init()
+	 ***/
+	void set_gpio_backend(GpioBackend *gpio);
+	
+	/**
+	 ** @brief Lossless recording - videos go into a raw memory-mapped container (see RawFrameWriter), pictures are saved as RAW_PICTURE_EXTENSION
+	 **
+	 ** @param raw True for raw, false for MJPEG videos and JPEG pictures
 	 ***/
-	void set_button_1();
+	void set_raw_recording(bool raw)
+	{
+		_raw_recording = raw;
+	}
 	
 	/**
-	 ** @brief Set button 2 to on
+	 ** @brief Also record flash-minus-ambient difference of strobed videos as a third file (see FlashDifference)
+	 **
+	 ** @param difference True to write N_diff next to N_lit and N_unlit
 	 ***/
-	void set_button_2();
+	void set_difference_video(bool difference)
+	{
+		_difference_video = difference;
+	}
+	
+	/**
+	 ** @brief Getter for GPIO backend, for setting up buttons
+	 ***/
+	GpioBackend* gpio()
+	{
+		return _gpio;
+	}
 	
 	/**
 	 ** @brief Getter for waitKey variable
@@ -128,26 +240,95 @@ public:
 	
 private:
 	/******	MEMBER VARIABLES ******/	
-	//OpenCV Video stream
-	cv::VideoCapture _camera;
+	//V4L2 video stream, used unless another frame source is set
+	V4L2Capture _live_camera;
+	
+	//Where frames come from, only touched by capture thread once it's running
+	FrameSource *_camera;
+	
+	//Frame source set from outside, deleted with the class
+	FrameSource *_owned_source;
+	
+#ifdef HAVE_PIGPIO
+	//pigpio, used unless another GPIO backend is set
+	PigpioBackend _pigpio;
+#endif
+	
+	//Where every pin read, write and wave goes
+	GpioBackend *_gpio;
+	
+	//GPIO backend set from outside, deleted with the class
+	GpioBackend *_owned_gpio;
 	cv::Size _camera_size;
+	
+	//Capture thread fills ring, recorder and preview read from it with their own cursors
+	FrameRing _frame_ring;
+	thread _capture_thread;
+	atomic<bool> _capture_running;
+	uint64_t _preview_cursor;
+	uint64_t _record_cursor;
 		
 	//OpenCV mat for video or pic
 	cv::Mat _image;
 	
-	//OpenCV video object for recording
-	cv::VideoWriter _video;
+	//Frame handed to recorder, kept separate from _image so preview overlays aren't recorded
+	cv::Mat _record_image;
+	FrameInfo _record_info;
+	
+	//Camera's JPEG handed to recorder when ring is compressed, written to file without decoding
+	std::vector<uchar> _record_data;
+	
+	//Encoder thread that owns the video file while recording, or the unlit file of a split video
+	VideoEncoder _video_encoder;
+	
+	//Encoder thread that owns the lit file of a split video
+	VideoEncoder _lit_encoder;
+	
+	//Video is strobed, so frames are routed by LED state into _lit_encoder and _video_encoder
+	bool _split_video;
+	
+	//Lit minus unlit frames while strobing, highlighted in preview and optionally written by _diff_encoder
+	FlashDifference _flash_difference;
+	VideoEncoder _diff_encoder;
+	bool _difference_video;
+	
+	//Finds eye reflections in _flash_difference's masks and logs them, only ever drops frames from its own analysis
+	EyeDetector _eye_detector;
+	
+	//Newest difference mask, drawn over preview
+	cv::Mat _flash_mask;
+	
+	//Videos are stored uncompressed and pictures lossless, for analysis
+	bool _raw_recording;
+	
+	//Compressed frames from before the video button, written ahead of live frames
+	PreTriggerBuffer _pretrigger;
+	
+	//Encoder is still writing pre-trigger frames, recorder holds off on live frames until it catches up
+	bool _prelude_pending;
 	
 	//CVUI parameters
 	bool _show_cvui;
 	
 	//Camera parameters
-	int _exposure, _exposure_prev;
-	int _brightness, _brightness_prev;
-	int _contrast, _contrast_prev;
-	int _saturation, _saturation_prev;
-	int _red_balance, _red_balance_prev;
-	int _blue_balance, _blue_balance_prev;
+	int _exposure;
+	int _brightness;
+	int _contrast;
+	int _saturation;
+	int _red_balance;
+	int _blue_balance;
+	
+	//Sends changed camera parameters to driver in one batched ioctl
+	CameraControls _camera_controls;
+	
+	//Camera parameters last sent without error, capture thread tags every frame with them
+	std::mutex _controls_mutex;
+	FrameControls _applied_controls;
+	
+	//Wakes main loop when a frame arrives or a button is pressed, so it never polls
+	std::mutex _event_mutex;
+	std::condition_variable _event_cv;
+	bool _event_pending;
 	
 	//For assigning waitKey to
 	char _esc_key;
@@ -160,6 +341,9 @@ private:
 	int _video_led_pin;
 	int _success_led_pin;
 	
+	//Runs every status LED pattern on one thread
+	LedController _led_controller;
+	
 	//Pins for buttons
 	int _button_1_pin;
 	int _button_2_pin;
@@ -168,14 +352,30 @@ private:
 	int _button_1_pressed;
 	int _button_2_pressed;
 	
+	//Presses waiting for main loop, one queue per button since pigpio runs each callback on its own thread
+	CommandQueue _button_1_queue;
+	CommandQueue _button_2_queue;
+	int _commands_dropped;		//Presses dropped by both queues that have already been reported
+	
+	//Time picture button was pressed (seconds, cv::getTickCount() clock)
+	double _button_1_timer;
+	
 	//Extra debounce for video
 	double _button_2_timer;
 		
-	//LED needs to be strobed
-	bool _led_state;
+	//Frame-locked strobe - main thread sets these, capture thread switches LEDs as frames arrive
+	atomic<bool> _strobe_enabled;
+	atomic<int> _strobe_mode;
+	atomic<int> _strobe_phase_us;
 	
-	//Timer for LED strobing
-	double _led_timer;
+	//LED_PULSE wave couldn't be built or sent, capture thread strobes the pin directly instead (cleared when a video starts)
+	atomic<bool> _strobe_pulse_failed;
+	
+	//LED level set by capture thread and when it last changed, or when the last pulse should be on (capture thread only)
+	StrobeState _strobe;
+	
+	//Hardware-timed pulses for LED_PULSE mode
+	StrobeGenerator _strobe_generator;
 	
 	//Information for file names and path of pictures and video
 	int _picture_count;
@@ -193,14 +393,54 @@ private:
 	//Two pictures need to be taken, keep track of which picture has been taken so far
 	int _picture_state;
 	
+	//Ring cursor for picture frames
+	uint64_t _picture_cursor;
+	
+	//Number of flash off/on pairs per picture button press, changed by counter
+	int _burst_pairs;
+	
+	//Preallocated frames for every pair in a burst, plus when LEDs turned on and how many partially lit frames were skipped
+	vector<cv::Mat> _burst_off_images;
+	vector<cv::Mat> _burst_on_images;
+	vector<FrameInfo> _burst_off_info;
+	vector<FrameInfo> _burst_on_info;
+	vector<double> _burst_led_on_time;
+	vector<int> _burst_discarded;
+	
+	//Pairs actually captured in last burst
+	int _burst_grabbed;
+	
+	//Lit frames after the first one of a pair, thrown away
+	cv::Mat _burst_extra_image;
+	FrameInfo _burst_extra_info;
+	
+	//Scratch frame while looking for a fully lit/unlit frame
+	cv::Mat _switch_image;
+	
+	//Workers that encode and write pictures, so main loop goes straight back to preview
+	ImageSaver _image_saver;
+	
+	//Picture log waiting on its images to be saved
+	struct PendingPicture
+	{
+		int picture_count;
+		string path;
+		string log;
+		int remaining;
+		int error_code;		//0 if every frame was captured and saved, otherwise ERROR_CODE_*
+	};
+	
+	//Pictures whose images are still being saved, oldest first
+	deque<PendingPicture> _pending_pictures;
+	
 	//Timer for how long video lasts
 	double _video_timer;
 	
 	//Need video state machine for whether it's starting, recording or if it's done
 	int _video_state;
 	
-	//Desired framerate for videos, changed by slider
-	int _video_frame_period;
+	//Delay (ms) between frame arriving and LEDs switching for next frame, changed by slider
+	int _strobe_phase;
 	
 	//For if LEDs are off, on, or they strobe when taking video
 	int _video_led_mode;
@@ -209,6 +449,16 @@ private:
 	int _frame_count;
 	double _frame_timer;
 	
+	//Per-frame timings of current video, written to its log as percentiles when it ends
+	LatencyHistogram _capture_histogram;	//Time between camera frames
+	LatencyHistogram _display_histogram;	//Preview read, draw and show
+	LatencyHistogram _loop_histogram;		//One pass of recorder loop
+	
+	//Frames of current video by flash LED state: off, on, switched mid-exposure
+	int _led_off_frames;
+	int _led_on_frames;
+	int _led_mixed_frames;
+	
 	//State of camera, refer to enums for states
 	int _camera_state;
 	
@@ -223,12 +473,57 @@ private:
 	//Records video, once flag has been turned off, save file
 	void _record_video();
 	
+	//Reads next frame for recorder from ring, as JPEG into _record_data when ring is compressed, otherwise into _record_image
+	bool _read_record_frame();
+	
 	//Turn flash on, take picture, turn flash off, take picture, save files
 	void _record_pictures();
 	
-	//Makes sure camera is initialized/turned on, sets width/height
+	//Makes a command for a button press, with the time the edge actually happened
+	Command _make_command(int type, uint32_t tick);
+	
+	//Main thread - applies every queued button press to the state machines, both buttons merged in press order
+	void _process_commands();
+	
+	//Main thread - applies one button press to the state machines
+	void _handle_command(const Command &command);
+	
+	//Wakes main loop, called by capture thread for new frames and by button ISRs
+	void _notify_event();
+	
+	//Sleeps until _notify_event() is called or timeout (ms) runs out
+	bool _wait_event(int timeout_ms);
+	
+	//Adds finished saves to their picture logs, writes a log once all its images are saved
+	void _finish_pictures();
+	
+	//Makes sure camera is initialized/turned on, sets width/height, starts capture thread
 	void _init_cam();
 	
+	//Stops capture thread and releases camera
+	void _release_cam();
+	
+	//Capture thread loop - only reads frames into ring, never waits on GUI or file IO
+	void _capture_frames();
+	
+	//Creates thread for _capture_frames
+	static void _capture_frames_thread(FishTestCamera* ptr);
+	
+	//Capture thread - switches flash LEDs for the next frame according to strobe mode
+	void _update_strobe();
+	
+	//Switches flash LEDs, then picks newest frame fully exposed before the switch and first frame fully exposed after it
+	bool _capture_flash_switch(int led_level, uint64_t &cursor, cv::Mat &before_image, FrameInfo &before_info, cv::Mat &after_image, FrameInfo &after_info, double &switch_time, int &discarded);
+	
+	//File name of one image in a burst, pair number is left out if burst is a single pair
+	string _burst_file_name(int pair_ind, bool flash_on);
+	
+	//File name of current video, suffix goes between video number and extension, which depends on recording mode
+	string _video_file_name(const string &suffix = "");
+	
+	//Opens encoder for one file of current video, with its sidecar, compressed if frames will be pushed as the camera's JPEGs
+	bool _open_video(VideoEncoder &encoder, const string &suffix, double fps, bool compressed);
+	
 	//Adds trackbars for certain parameters to be adjusted
 	void _add_trackbars();
 	
@@ -239,14 +534,8 @@ private:
 	string _get_time();
 	
 	//Write to a file holding log info in the specified folder
-	void _write_file(string input, string path);	
-	
-	//If successful, flash the green LEDs
-	void _show_success();
-	
-	//Creates thread for _show_success
-	static void _show_success_thread(FishTestCamera* ptr);
+	void _write_file(string input, string path);
 	
-	//Function invoked to actually start the thread
-	void _call_show_success();
+	//Makes folder and any missing parent folders, without going through a shell
+	bool _make_dir(string path);	
 };
\ No newline at end of file
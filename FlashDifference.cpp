@@ -0,0 +1,271 @@
+#include "FlashDifference.h"
+
+FlashDifference::FlashDifference()
+{
+	_ring = NULL;
+	_cursor = 0;
+	_running = false;
+	_threshold = 0;
+	_output = NULL;
+	_detector = NULL;
+	_paired_index = 0;
+	_latest_new = false;
+	_pairs = 0;
+	_frames_read = 0;
+	_frames_switched = 0;
+}
+
+FlashDifference::~FlashDifference()
+{
+	stop();
+}
+
+//Starts pairing lit and unlit frames from ring
+void FlashDifference::start(FrameRing *ring, int threshold, VideoEncoder *output, EyeDetector *detector)
+{
+	stop();
+
+	_ring = ring;
+	_threshold = std::max(0, std::min(255, threshold));
+	_output = output;
+	_detector = detector;
+
+	//Only frames from now on, nothing before them can be paired
+	_cursor = _ring->head();
+	_paired_index = _cursor;
+	_lit_info.index = 0;
+	_unlit_info.index = 0;
+
+	_pairs = 0;
+	_frames_read = 0;
+	_frames_switched = 0;
+	_compute_histogram.reset();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_latest_new = false;
+	}
+
+	_running = true;
+	_thread = std::thread(&FlashDifference::_difference_frames_thread, this);
+}
+
+//Stops worker thread
+void FlashDifference::stop()
+{
+	_running = false;
+
+	if (_thread.joinable())
+	{
+		_thread.join();
+	}
+}
+
+//Copies out newest mask
+bool FlashDifference::latest_mask(cv::Mat &mask)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_latest_new == false)
+	{
+		return false;
+	}
+
+	_latest_mask.copyTo(mask);
+	_latest_new = false;
+
+	return true;
+}
+
+//Pairs found and time taken per difference
+std::string FlashDifference::report()
+{
+	std::stringstream report_ss;
+
+	report_ss << "Flash difference pairs: " << _pairs << " from " << _frames_read << " frames\n";
+	report_ss << "Frames not differenced: " << _frames_switched << " with LEDs switched during exposure, " << frames_unpaired() << " without a lit/unlit neighbour\n";
+	report_ss << _compute_histogram.report("Flash difference time");
+
+	return report_ss.str();
+}
+
+//Saturating lit - unlit of every channel
+bool FlashDifference::compute(const cv::Mat &lit, const cv::Mat &unlit, cv::Mat &diff, cv::Mat *mask, int threshold)
+{
+	if (lit.empty() || lit.size() != unlit.size() || lit.type() != unlit.type() || lit.depth() != CV_8U)
+	{
+		return false;
+	}
+
+	diff.create(lit.size(), lit.type());
+
+	if (mask != NULL)
+	{
+		mask->create(lit.size(), CV_8UC1);
+	}
+
+	int channels = lit.channels();
+	int rows = lit.rows;
+	int cols = lit.cols;
+
+	//Continuous frames are done as one long row
+	if (lit.isContinuous() && unlit.isContinuous() && diff.isContinuous() && (mask == NULL || mask->isContinuous()))
+	{
+		cols *= rows;
+		rows = 1;
+	}
+
+	for (int row = 0; row < rows; row++)
+	{
+		const uchar *lit_row = lit.ptr(row);
+		const uchar *unlit_row = unlit.ptr(row);
+		uchar *diff_row = diff.ptr(row);
+		uchar *mask_row = (mask != NULL) ? mask->ptr(row) : NULL;
+
+		int col = 0;
+
+#if CV_SIMD
+		//One vector of pixels at a time, 8-bit subtraction saturates at 0 and comparisons give 0xFF/0x00 lanes
+		const int lanes = CV_SIMD_WIDTH;
+		cv::v_uint8 thresh = cv::vx_setall_u8((uchar)threshold);
+
+		if (channels == 3)
+		{
+			for (; col <= cols - lanes; col += lanes)
+			{
+				cv::v_uint8 lit_b, lit_g, lit_r, unlit_b, unlit_g, unlit_r;
+				cv::v_load_deinterleave(lit_row + 3 * col, lit_b, lit_g, lit_r);
+				cv::v_load_deinterleave(unlit_row + 3 * col, unlit_b, unlit_g, unlit_r);
+
+				cv::v_uint8 diff_b = lit_b - unlit_b;
+				cv::v_uint8 diff_g = lit_g - unlit_g;
+				cv::v_uint8 diff_r = lit_r - unlit_r;
+				cv::v_store_interleave(diff_row + 3 * col, diff_b, diff_g, diff_r);
+
+				if (mask_row != NULL)
+				{
+					cv::v_store(mask_row + col, cv::v_max(diff_b, cv::v_max(diff_g, diff_r)) > thresh);
+				}
+			}
+		}
+		else if (channels == 1)
+		{
+			for (; col <= cols - lanes; col += lanes)
+			{
+				cv::v_uint8 diff_v = cv::vx_load(lit_row + col) - cv::vx_load(unlit_row + col);
+				cv::v_store(diff_row + col, diff_v);
+
+				if (mask_row != NULL)
+				{
+					cv::v_store(mask_row + col, diff_v > thresh);
+				}
+			}
+		}
+#endif
+
+		//Pixels left over at the end of the row, or all of them without SIMD
+		for (; col < cols; col++)
+		{
+			int max_diff = 0;
+
+			for (int channel = 0; channel < channels; channel++)
+			{
+				int pixel_diff = std::max(0, lit_row[col * channels + channel] - unlit_row[col * channels + channel]);
+				diff_row[col * channels + channel] = (uchar)pixel_diff;
+				max_diff = std::max(max_diff, pixel_diff);
+			}
+
+			if (mask_row != NULL)
+			{
+				mask_row[col] = (max_diff > threshold) ? 255 : 0;
+			}
+		}
+	}
+
+#if CV_SIMD
+	cv::vx_cleanup();
+#endif
+
+	return true;
+}
+
+//Worker loop
+void FlashDifference::_difference_frames()
+{
+	FrameInfo info;
+
+	while (_running)
+	{
+		if (_ring->wait(_cursor, FLASH_DIFF_POLL_TIMEOUT) == false)
+		{
+			continue;
+		}
+
+		while (_running && _ring->read(_cursor, _frame, info))
+		{
+			_frames_read++;
+
+			//Keep newest of each, frames lit for only part of their exposure can't be used
+			if (info.led_state == 1)
+			{
+				cv::swap(_frame, _lit);
+				_lit_info = info;
+			}
+			else if (info.led_state == 0)
+			{
+				cv::swap(_frame, _unlit);
+				_unlit_info = info;
+			}
+			else
+			{
+				_frames_switched++;
+				continue;
+			}
+
+			//Only frames next to each other in the ring are paired, so little has moved between them and no motion compensation is needed
+			bool adjacent = (_lit_info.index + 1 == _unlit_info.index || _unlit_info.index + 1 == _lit_info.index);
+
+			if (adjacent == false || std::min(_lit_info.index, _unlit_info.index) <= _paired_index)
+			{
+				continue;
+			}
+
+			_paired_index = info.index;
+
+			double compute_timer = cv::getTickCount();
+
+			if (compute(_lit, _unlit, _diff, (_threshold > 0) ? &_mask : NULL, _threshold) == false)
+			{
+				continue;
+			}
+
+			_compute_histogram.record(1000 * (cv::getTickCount() - compute_timer) / cv::getTickFrequency());
+			_pairs++;
+
+			//Difference is tagged with the lit frame, so it lines up with that frame's sidecar record
+			if (_output != NULL)
+			{
+				_output->push(_diff, _lit_info);
+			}
+
+			//Detector copies what it needs or drops the frame, it never holds this thread up
+			if (_detector != NULL && _threshold > 0)
+			{
+				_detector->submit(_diff, _mask, _lit_info);
+			}
+
+			if (_threshold > 0)
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_mask.copyTo(_latest_mask);
+				_latest_new = true;
+			}
+		}
+	}
+}
+
+//Start thread for _difference_frames
+void FlashDifference::_difference_frames_thread(FlashDifference* ptr)
+{
+	ptr->_difference_frames();
+}
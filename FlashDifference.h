@@ -0,0 +1,144 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+
+#include "FrameRing.h"
+#include "VideoEncoder.h"
+#include "EyeDetector.h"
+#include "LatencyHistogram.h"
+
+#define FLASH_DIFF_POLL_TIMEOUT	100		//Time (ms) worker waits on ring before checking if it should stop
+
+//Flash-minus-ambient difference of adjacent lit and unlit frames, which leaves mostly the eye-shine the strobe lights up
+//Runs on its own thread with its own ring cursor, the newest mask goes to the preview and every difference can go to an encoder
+class FlashDifference
+{
+public:
+	FlashDifference();
+	~FlashDifference();
+
+	/**
+	 ** @brief Starts pairing lit and unlit frames from ring and computing their difference
+	 **
+	 ** @param ring Frame ring to read from, must not be re-initialized while running
+	 ** @param threshold Difference (0-255) a pixel needs in any channel to be in the mask, 0 for no mask
+	 ** @param output Open encoder every difference frame is pushed to, NULL for none
+	 ** @param detector Running eye detector every difference and mask is handed to, NULL for none (needs threshold > 0)
+	 ***/
+	void start(FrameRing *ring, int threshold, VideoEncoder *output = NULL, EyeDetector *detector = NULL);
+
+	/**
+	 ** @brief Stops worker thread, call before closing output
+	 ***/
+	void stop();
+
+	bool is_running()
+	{
+		return _running;
+	}
+
+	/**
+	 ** @brief Copies out newest mask, for highlighting the preview
+	 **
+	 **	@return false if there's been no new mask since last call (mask is left as it was)
+	 ***/
+	bool latest_mask(cv::Mat &mask);
+
+	/**
+	 ** @brief Pairs found and time taken per difference, only call after stop()
+	 ***/
+	std::string report();
+
+	/**
+	 ** @brief Time (ms) taken by each difference, only call after stop()
+	 ***/
+	const LatencyHistogram& compute_histogram()
+	{
+		return _compute_histogram;
+	}
+
+	/**
+	 ** @brief Lit/unlit pairs differenced, only call after stop()
+	 ***/
+	int pairs()
+	{
+		return _pairs;
+	}
+
+	/**
+	 ** @brief Frames tagged with LEDs switching partway through their exposure, never used in a pair, only call after stop()
+	 ***/
+	int frames_switched()
+	{
+		return _frames_switched;
+	}
+
+	/**
+	 ** @brief Lit or unlit frames without a neighbour of the other state to pair with, only call after stop()
+	 ***/
+	int frames_unpaired()
+	{
+		return _frames_read - _frames_switched - 2 * _pairs;
+	}
+
+	/**
+	 ** @brief Saturating lit - unlit of every channel, vectorized with OpenCV's universal intrinsics (NEON on the Pi)
+	 **
+	 ** @param lit Frame with flash LEDs on, 8-bit
+	 ** @param unlit Frame with flash LEDs off, same size and type
+	 ** @param diff Difference, reallocated only if size or type changes
+	 ** @param mask If not NULL, set to 255 where any channel's difference is above threshold, 0 elsewhere (CV_8UC1)
+	 ** @param threshold Threshold for mask
+	 **	@return false if frames don't match
+	 ***/
+	static bool compute(const cv::Mat &lit, const cv::Mat &unlit, cv::Mat &diff, cv::Mat *mask, int threshold);
+
+private:
+	FrameRing *_ring;
+	uint64_t _cursor;
+
+	std::thread _thread;
+	std::atomic<bool> _running;
+
+	int _threshold;
+	VideoEncoder *_output;
+	EyeDetector *_detector;
+
+	//Newest lit and unlit frames, buffers are swapped rather than copied (worker thread only)
+	cv::Mat _frame;
+	cv::Mat _lit;
+	cv::Mat _unlit;
+	FrameInfo _lit_info;
+	FrameInfo _unlit_info;
+
+	//Ring index of newest frame used in a pair, so pairs never share a frame
+	uint64_t _paired_index;
+
+	cv::Mat _diff;
+	cv::Mat _mask;
+
+	//Newest mask for preview, protected by _mutex
+	std::mutex _mutex;
+	cv::Mat _latest_mask;
+	bool _latest_new;
+
+	//Stats, worker thread only
+	int _pairs;
+	int _frames_read;
+	int _frames_switched;
+	LatencyHistogram _compute_histogram;
+
+	//Worker loop
+	void _difference_frames();
+
+	//Creates thread for _difference_frames
+	static void _difference_frames_thread(FlashDifference* ptr);
+};
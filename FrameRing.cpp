@@ -0,0 +1,311 @@
+#include "FrameRing.h"
+
+FrameRing::FrameRing()
+{
+	_type = 0;
+	_compressed_bytes = 0;
+	_head = 0;
+}
+
+FrameRing::~FrameRing()
+{
+	_free_slots();
+}
+
+//Preallocates all frame slots
+void FrameRing::init(int capacity, cv::Size size, int type, size_t compressed_bytes)
+{
+	_free_slots();
+
+	//Need at least one slot being written and one slot being read
+	if (capacity < 2)
+	{
+		capacity = 2;
+	}
+
+	_size = size;
+	_type = type;
+	_compressed_bytes = compressed_bytes;
+
+	for (int slot_ind = 0; slot_ind < capacity; slot_ind++)
+	{
+		Slot *slot = new Slot;
+
+		//Compressed ring never holds pixels
+		if (compressed_bytes > 0)
+		{
+			slot->data.resize(compressed_bytes);
+		}
+		else
+		{
+			slot->buffer.create(size, type);
+		}
+
+		slot->image = slot->buffer;
+		slot->data_size = 0;
+		slot->info.index = 0;
+		slot->info.timestamp = 0;
+		slot->info.sequence = 0;
+		slot->info.exposure_start = 0;
+		slot->info.exposure_end = 0;
+		slot->info.led_state = 0;
+		slot->seq = 0;
+
+		_slots.push_back(slot);
+	}
+
+	_head = 0;
+}
+
+//Returns next slot to be filled by the producer
+cv::Mat& FrameRing::write_slot()
+{
+	uint64_t index = _head.load(std::memory_order_relaxed) + 1;
+	Slot *slot = _slots[index % _slots.size()];
+
+	//Mark slot as being written so readers reject it until publish
+	slot->seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	return slot->image;
+}
+
+//Makes the frame in write_slot() visible to consumers
+bool FrameRing::publish(const FrameInfo &info)
+{
+	uint64_t index = _head.load(std::memory_order_relaxed) + 1;
+	Slot *slot = _slots[index % _slots.size()];
+
+	//Producer wrote a frame of a different size/type, so the header was reallocated away from the ring memory
+	if (slot->image.data != slot->buffer.data)
+	{
+		slot->image = slot->buffer;
+		return false;
+	}
+
+	slot->info = info;
+	slot->info.index = index;
+
+	//Publish slot, then move head forward
+	slot->seq.store(index, std::memory_order_release);
+	_head.store(index, std::memory_order_release);
+
+	//Wake anyone blocked in wait(), lock is only held to avoid missing the wakeup
+	{
+		std::lock_guard<std::mutex> lock(_wait_mutex);
+	}
+	_wait_cv.notify_all();
+
+	return true;
+}
+
+//Copies JPEG frame into next slot and makes it visible to consumers
+bool FrameRing::publish_compressed(const uchar *data, size_t size, const FrameInfo &info)
+{
+	uint64_t index = _head.load(std::memory_order_relaxed) + 1;
+	Slot *slot = _slots[index % _slots.size()];
+
+	if (size == 0 || size > slot->data.size())
+	{
+		return false;
+	}
+
+	//Mark slot as being written so readers reject it until it's published
+	slot->seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	memcpy(&slot->data[0], data, size);
+	slot->data_size = size;
+	slot->info = info;
+	slot->info.index = index;
+
+	//Publish slot, then move head forward
+	slot->seq.store(index, std::memory_order_release);
+	_head.store(index, std::memory_order_release);
+
+	{
+		std::lock_guard<std::mutex> lock(_wait_mutex);
+	}
+	_wait_cv.notify_all();
+
+	return true;
+}
+
+//Copies oldest frame newer than cursor
+bool FrameRing::read(uint64_t &cursor, cv::Mat &image, FrameInfo &info)
+{
+	uint64_t head = _head.load(std::memory_order_acquire);
+	uint64_t capacity = _slots.size();
+
+	//Ring was re-initialized since this consumer last read
+	if (cursor > head)
+	{
+		cursor = head;
+	}
+
+	while (cursor < head)
+	{
+		uint64_t next = cursor + 1;
+
+		//Slot after head may be mid-write, so only the newest (capacity - 1) frames can be read
+		if (head + 2 > capacity && next < head + 2 - capacity)
+		{
+			next = head + 2 - capacity;
+		}
+
+		cursor = next;
+
+		if (_copy_frame(next, image, info))
+		{
+			return true;
+		}
+
+		//Producer lapped us during the copy, try again with newer head
+		head = _head.load(std::memory_order_acquire);
+	}
+
+	return false;
+}
+
+//Copies newest frame if it is newer than cursor
+bool FrameRing::read_latest(uint64_t &cursor, cv::Mat &image, FrameInfo &info)
+{
+	uint64_t head = _head.load(std::memory_order_acquire);
+
+	while (head != cursor)
+	{
+		cursor = head;
+
+		if (_copy_frame(head, image, info))
+		{
+			return true;
+		}
+
+		head = _head.load(std::memory_order_acquire);
+	}
+
+	return false;
+}
+
+//Same as read() but copies the JPEG bitstream
+bool FrameRing::read_compressed(uint64_t &cursor, std::vector<uchar> &data, FrameInfo &info)
+{
+	uint64_t head = _head.load(std::memory_order_acquire);
+	uint64_t capacity = _slots.size();
+
+	if (cursor > head)
+	{
+		cursor = head;
+	}
+
+	while (cursor < head)
+	{
+		uint64_t next = cursor + 1;
+
+		if (head + 2 > capacity && next < head + 2 - capacity)
+		{
+			next = head + 2 - capacity;
+		}
+
+		cursor = next;
+
+		if (_copy_compressed(next, data, info))
+		{
+			return true;
+		}
+
+		head = _head.load(std::memory_order_acquire);
+	}
+
+	return false;
+}
+
+//Blocks until a frame newer than cursor is published
+bool FrameRing::wait(uint64_t cursor, int timeout_ms)
+{
+	//A cursor ahead of head means ring was re-initialized, let read() resync it
+	if (head() != cursor)
+	{
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock(_wait_mutex);
+
+	return _wait_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this, cursor]() { return head() != cursor; });
+}
+
+//Copies frame at index out of the ring, false if it was overwritten during the copy
+bool FrameRing::_copy_frame(uint64_t index, cv::Mat &image, FrameInfo &info)
+{
+	if (_slots.empty() || index == 0)
+	{
+		return false;
+	}
+
+	//Copy JPEG out first so producer can't change it mid-decode, each consumer thread keeps its own buffer
+	if (_compressed_bytes > 0)
+	{
+		static thread_local std::vector<uchar> data;
+
+		if (_copy_compressed(index, data, info) == false)
+		{
+			return false;
+		}
+
+		//Decodes straight into image's memory if it's already the right size
+		cv::imdecode(data, cv::IMREAD_COLOR, &image);
+
+		return image.empty() == false;
+	}
+
+	Slot *slot = _slots[index % _slots.size()];
+
+	if (slot->seq.load(std::memory_order_acquire) != index)
+	{
+		return false;
+	}
+
+	slot->buffer.copyTo(image);
+	info = slot->info;
+
+	//Make sure producer didn't start overwriting slot while we copied it
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	return slot->seq.load(std::memory_order_relaxed) == index;
+}
+
+//Copies JPEG frame at index out of the ring
+bool FrameRing::_copy_compressed(uint64_t index, std::vector<uchar> &data, FrameInfo &info)
+{
+	if (_slots.empty() || index == 0)
+	{
+		return false;
+	}
+
+	Slot *slot = _slots[index % _slots.size()];
+
+	if (slot->seq.load(std::memory_order_acquire) != index)
+	{
+		return false;
+	}
+
+	//Size may be torn if producer got here first, keep it in bounds and let the sequence check catch it
+	size_t size = std::min(slot->data_size, slot->data.size());
+	data.assign(slot->data.begin(), slot->data.begin() + size);
+	info = slot->info;
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	return slot->seq.load(std::memory_order_relaxed) == index;
+}
+
+//Frees all slots
+void FrameRing::_free_slots()
+{
+	for (size_t slot_ind = 0; slot_ind < _slots.size(); slot_ind++)
+	{
+		delete _slots[slot_ind];
+	}
+
+	_slots.clear();
+}
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+//Camera and strobe settings in effect when a frame was captured
+struct FrameControls
+{
+	int exposure;
+	int brightness;
+	int contrast;
+	int saturation;
+	int red_balance;
+	int blue_balance;
+	int strobe_mode;
+	int strobe_phase_us;
+};
+
+//Information stored with every frame that goes through the ring
+struct FrameInfo
+{
+	uint64_t index;			//Frame number since the ring was created, starts at 1 (0 means no frame)
+	double timestamp;		//Capture time in seconds, same clock as cv::getTickCount()
+	uint32_t sequence;		//Camera driver's frame counter
+	double exposure_start;	//Time first row of frame started exposing (seconds, same clock as timestamp)
+	double exposure_end;	//Time last row of frame finished exposing
+	int led_state;			//Flash LEDs during exposure: 1 on, 0 off, -1 if they switched mid-exposure
+	FrameControls controls;	//Settings frame was captured with
+};
+
+//Frame compressed to JPEG, with the metadata it had in the ring
+struct CompressedFrame
+{
+	std::vector<uchar> data;
+	FrameInfo info;
+};
+
+class FrameRing
+{
+public:
+	FrameRing();
+	~FrameRing();
+
+	/**
+	 ** @brief Preallocates all frame slots, only call when no producer or consumer is running
+	 **
+	 ** @param capacity Number of frames held by the ring
+	 ** @param size Width/height of every frame
+	 ** @param type OpenCV type of every frame (i.e. CV_8UC3)
+	 ** @param compressed_bytes If > 0, ring holds JPEG frames of up to this many bytes (see publish_compressed)
+	 ***/
+	void init(int capacity, cv::Size size, int type, size_t compressed_bytes = 0);
+
+	/**
+	 ** @brief Producer only - returns the next slot to be filled, frame is not visible until publish()
+	 ***/
+	cv::Mat& write_slot();
+
+	/**
+	 ** @brief Producer only - makes the frame in write_slot() visible to consumers
+	 **
+	 ** @param info Metadata of frame, index is filled in by the ring
+	 **	@return false if slot had to be discarded (frame didn't match ring size/type)
+	 ***/
+	bool publish(const FrameInfo &info);
+
+	/**
+	 ** @brief Producer only, compressed ring - copies a JPEG frame into the next slot and makes it visible to consumers
+	 **
+	 ** Frame is only decoded if a consumer asks for pixels with read() or read_latest()
+	 **
+	 ** @param data JPEG bitstream, i.e. straight from the camera's buffer
+	 ** @param size Bytes of data
+	 ** @param info Metadata of frame, index is filled in by the ring
+	 **	@return false if frame was bigger than the slots and was discarded
+	 ***/
+	bool publish_compressed(const uchar *data, size_t size, const FrameInfo &info);
+
+	/**
+	 ** @brief Copies the oldest frame newer than cursor, and advances cursor to it, decoding it if ring is compressed
+	 **
+	 ** @param cursor Index of last frame this consumer has read
+	 ** @param image Destination for frame (reused if already allocated)
+	 ** @param info Metadata of frame read, gaps in info.index mean consumer was lapped
+	 **	@return false if no newer frame is available
+	 ***/
+	bool read(uint64_t &cursor, cv::Mat &image, FrameInfo &info);
+
+	/**
+	 ** @brief Same as read() but skips straight to the newest frame
+	 ***/
+	bool read_latest(uint64_t &cursor, cv::Mat &image, FrameInfo &info);
+
+	/**
+	 ** @brief Compressed ring only - same as read() but copies the JPEG bitstream without decoding it
+	 ***/
+	bool read_compressed(uint64_t &cursor, std::vector<uchar> &data, FrameInfo &info);
+
+	/**
+	 ** @brief Blocks until a frame newer than cursor is published
+	 **
+	 **	@return false if timeout_ms passed with no new frame
+	 ***/
+	bool wait(uint64_t cursor, int timeout_ms);
+
+	/**
+	 ** @brief Index of newest published frame
+	 ***/
+	uint64_t head() const
+	{
+		return _head.load(std::memory_order_acquire);
+	}
+
+	cv::Size size() const
+	{
+		return _size;
+	}
+
+	int type() const
+	{
+		return _type;
+	}
+
+	bool empty() const
+	{
+		return _slots.empty();
+	}
+
+	/**
+	 ** @brief Whether ring holds JPEG frames rather than images
+	 ***/
+	bool compressed() const
+	{
+		return _compressed_bytes > 0;
+	}
+
+private:
+	struct Slot
+	{
+		//Owns the pixels, header never changes after init so readers can use it safely
+		cv::Mat buffer;
+
+		//Header handed to producer, may get reallocated if producer writes wrong size
+		cv::Mat image;
+
+		//JPEG frame in a compressed ring, preallocated to the max size so copying in never allocates
+		std::vector<uchar> data;
+		size_t data_size;
+
+		FrameInfo info;
+
+		//Index of frame held in slot, 0 while producer is writing to it
+		std::atomic<uint64_t> seq;
+	};
+
+	//Slots are never moved after init, so use pointers to hold atomics
+	std::vector<Slot*> _slots;
+
+	cv::Size _size;
+	int _type;
+	size_t _compressed_bytes;
+
+	//Newest published frame index
+	std::atomic<uint64_t> _head;
+
+	//Used only for waking up consumers blocked in wait()
+	std::mutex _wait_mutex;
+	std::condition_variable _wait_cv;
+
+	//Copies frame at index out of the ring (decoding it if compressed), false if it was overwritten during the copy
+	bool _copy_frame(uint64_t index, cv::Mat &image, FrameInfo &info);
+
+	//Copies JPEG frame at index out of the ring, false if it was overwritten during the copy
+	bool _copy_compressed(uint64_t index, std::vector<uchar> &data, FrameInfo &info);
+
+	//Frees all slots
+	void _free_slots();
+};
@@ -0,0 +1,89 @@
+#include "FrameSidecar.h"
+
+FrameSidecar::FrameSidecar()
+{
+	_buffer.resize(SIDECAR_BUFFER_SIZE);
+	_records = 0;
+	_failed = false;
+}
+
+FrameSidecar::~FrameSidecar()
+{
+	close();
+}
+
+//Creates file and writes header
+bool FrameSidecar::open(const std::string &path, double fps)
+{
+	close();
+
+	//Buffer has to be set before the file is opened to take effect
+	_file.rdbuf()->pubsetbuf(&_buffer[0], _buffer.size());
+	_file.open(path, std::ios::binary | std::ios::trunc);
+
+	if (_file.is_open() == false)
+	{
+		return false;
+	}
+
+	SidecarHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SIDECAR_MAGIC, sizeof(header.magic));
+	header.version = SIDECAR_VERSION;
+	header.header_size = sizeof(SidecarHeader);
+	header.record_size = sizeof(SidecarRecord);
+	header.fps = fps;
+
+	_file.write((const char*)&header, sizeof(header));
+
+	_records = 0;
+	_failed = _file.fail();
+
+	return true;
+}
+
+//Adds the next frame's record
+void FrameSidecar::append(const FrameInfo &info, bool pretrigger)
+{
+	if (_file.is_open() == false)
+	{
+		return;
+	}
+
+	SidecarRecord record;
+	record.frame = _records;
+	record.sequence = info.sequence;
+	record.index = info.index;
+	record.timestamp = info.timestamp;
+	record.exposure_start = info.exposure_start;
+	record.exposure_end = info.exposure_end;
+	record.led_state = info.led_state;
+	record.pretrigger = pretrigger ? 1 : 0;
+	record.exposure = info.controls.exposure;
+	record.brightness = info.controls.brightness;
+	record.contrast = info.controls.contrast;
+	record.saturation = info.controls.saturation;
+	record.red_balance = info.controls.red_balance;
+	record.blue_balance = info.controls.blue_balance;
+	record.strobe_mode = info.controls.strobe_mode;
+	record.strobe_phase_us = info.controls.strobe_phase_us;
+
+	_file.write((const char*)&record, sizeof(record));
+
+	_records++;
+	_failed = _failed || _file.fail();
+}
+
+//Flushes buffered records and closes file
+bool FrameSidecar::close()
+{
+	if (_file.is_open() == false)
+	{
+		return _failed == false;
+	}
+
+	_file.close();
+	_failed = _failed || _file.fail();
+
+	return _failed == false;
+}
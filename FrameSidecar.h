@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "FrameRing.h"
+
+#define SIDECAR_MAGIC		"FISHMETA"	//First 8 bytes of every sidecar file
+#define SIDECAR_VERSION		1			//Bump when record layout changes
+#define SIDECAR_BUFFER_SIZE	65536		//Bytes buffered before a write hits the file
+
+//Start of sidecar file, records follow straight after it
+struct SidecarHeader
+{
+	char magic[8];				//SIDECAR_MAGIC, not null terminated
+	uint32_t version;			//SIDECAR_VERSION
+	uint32_t header_size;		//sizeof(SidecarHeader), records start at this offset
+	uint32_t record_size;		//sizeof(SidecarRecord)
+	uint32_t reserved;
+	double fps;					//Frame rate stored in the video file
+};
+
+//One frame of the video, fixed size and naturally aligned so a reader can mmap the file and index records directly
+//Little-endian, as written by the Pi
+struct SidecarRecord
+{
+	uint32_t frame;				//Position in the video file, from 0
+	uint32_t sequence;			//Camera driver's frame counter
+	uint64_t index;				//Frame ring index, gaps mean frames the recorder missed
+	double timestamp;			//Capture time (seconds, cv::getTickCount() clock)
+	double exposure_start;		//Same clock as timestamp
+	double exposure_end;
+	int32_t led_state;			//Flash LEDs during exposure: 1 on, 0 off, -1 if they switched mid-exposure
+	int32_t pretrigger;			//1 if frame came from pre-trigger buffer
+	int32_t exposure;			//Camera controls in effect at capture
+	int32_t brightness;
+	int32_t contrast;
+	int32_t saturation;
+	int32_t red_balance;
+	int32_t blue_balance;
+	int32_t strobe_mode;
+	int32_t strobe_phase_us;
+};
+
+static_assert(sizeof(SidecarHeader) == 32, "Sidecar header layout changed, bump SIDECAR_VERSION");
+static_assert(sizeof(SidecarRecord) == 80, "Sidecar record layout changed, bump SIDECAR_VERSION");
+
+//Append-only binary file with one fixed-size record per video frame
+//Only one thread may use it
+class FrameSidecar
+{
+public:
+	FrameSidecar();
+	~FrameSidecar();
+
+	/**
+	 ** @brief Creates file and writes header
+	 **
+	 ** @param path Path of sidecar file
+	 ** @param fps Frame rate of the video it goes with
+	 **	@return false if file couldn't be created
+	 ***/
+	bool open(const std::string &path, double fps);
+
+	/**
+	 ** @brief Adds the next frame's record, buffered so most calls don't touch the file
+	 **
+	 ** @param info Metadata of frame
+	 ** @param pretrigger Whether frame came from pre-trigger buffer
+	 ***/
+	void append(const FrameInfo &info, bool pretrigger);
+
+	/**
+	 ** @brief Flushes buffered records and closes file
+	 **
+	 **	@return false if any write failed
+	 ***/
+	bool close();
+
+	bool is_open()
+	{
+		return _file.is_open();
+	}
+
+	/**
+	 ** @brief Number of records appended since open()
+	 ***/
+	uint32_t records()
+	{
+		return _records;
+	}
+
+private:
+	std::ofstream _file;
+
+	//Stream buffer, allocated once so appends never allocate
+	std::vector<char> _buffer;
+
+	uint32_t _records;
+	bool _failed;
+};
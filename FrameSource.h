@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#define SENSOR_LINE_TIME	25e-6	//Time (s) rolling shutter takes to read out one row, a frame's readout is this times its height
+
+//One grabbed frame, image may point straight into the source's memory
+struct SourceFrame
+{
+	cv::Mat image;			//Zero-copy header over the frame, only valid until release()
+	int buffer_index;		//Source buffer index, -1 if frame isn't holding a buffer
+	uint32_t sequence;		//Frame counter, gaps mean the source dropped frames
+	double timestamp;		//Capture time in seconds, CLOCK_MONOTONIC (same clock as cv::getTickCount())
+	uint32_t bytes_used;	//Bytes of valid data in buffer (size of compressed frame for MJPEG)
+	uint32_t flags;			//V4L2_BUF_FLAG_* from the driver, 0 for other sources
+	double exposure_start;	//Estimated time first row started exposing (seconds, same clock as timestamp)
+	double exposure_end;	//Estimated time last row finished exposing
+};
+
+/**
+ ** @brief Time between first row and last row of a frame starting to expose (rolling shutter), so the frame's exposure window is exposure + readout
+ **
+ ** @param rows Height of frame
+ ** @param exposure_time Exposure of each row (seconds)
+ ** @param frame_period Time between frames (seconds), 0 if not known yet
+ ***/
+inline double sensor_readout_time(int rows, double exposure_time, double frame_period)
+{
+	double readout_time = rows * SENSOR_LINE_TIME;
+
+	//Sensor has to finish reading out a frame before the next one's last row starts, so it never takes longer than the period leaves after exposure
+	if (frame_period > 0)
+	{
+		readout_time = std::min(readout_time, std::max(0.0, frame_period - exposure_time));
+	}
+
+	return readout_time;
+}
+
+//Anything the capture thread can pull frames from: live camera, recorded footage or generated frames
+class FrameSource
+{
+public:
+	virtual ~FrameSource() {}
+
+	/**
+	 ** @brief Starts delivering frames
+	 **
+	 ** @param size Requested width/height, source may adjust it (check size() afterwards)
+	 **	@return true if frames can be grabbed
+	 ***/
+	virtual bool open(cv::Size size) = 0;
+
+	/**
+	 ** @brief Stops delivering frames and frees everything open() set up
+	 ***/
+	virtual void close() = 0;
+
+	virtual bool is_open() = 0;
+
+	/**
+	 ** @brief Waits for next frame, must be handed back with release()
+	 **
+	 ** @param frame Filled with image header, timestamp and sequence
+	 ** @param timeout_ms Time to wait for a frame
+	 **	@return false on timeout or error
+	 ***/
+	virtual bool grab(SourceFrame &frame, int timeout_ms) = 0;
+
+	/**
+	 ** @brief Converts a grabbed frame into a BGR image of size() (reuses image memory if already allocated)
+	 ***/
+	virtual bool convert(const SourceFrame &frame, cv::Mat &image) = 0;
+
+	/**
+	 ** @brief Whether grabbed frames are JPEG bitstreams (image is 1 x bytes_used), so they can be stored or recorded without decoding
+	 ***/
+	virtual bool compressed()
+	{
+		return false;
+	}
+
+	/**
+	 ** @brief Gives frame's buffer back to the source
+	 ***/
+	virtual void release(SourceFrame &frame) = 0;
+
+	virtual cv::Size size() = 0;
+
+	/**
+	 ** @brief Exposure time currently set on the sensor, used to estimate each frame's exposure window
+	 **
+	 ** @param seconds Exposure time in seconds
+	 ***/
+	virtual void set_exposure_time(double seconds) {}
+
+	/**
+	 ** @brief V4L2 file descriptor for camera controls, -1 if source has none
+	 ***/
+	virtual int fd()
+	{
+		return -1;
+	}
+};
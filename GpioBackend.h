@@ -0,0 +1,114 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+//Pin modes, same values as pigpio's PI_INPUT/PI_OUTPUT
+enum
+{
+	GPIO_INPUT = 0,
+	GPIO_OUTPUT = 1
+};
+
+//Pull-up/down resistors, same values as pigpio's PI_PUD_*
+enum
+{
+	GPIO_PUD_OFF = 0,
+	GPIO_PUD_DOWN = 1,
+	GPIO_PUD_UP = 2
+};
+
+//Edges that trigger a callback, same values as pigpio's *_EDGE
+enum
+{
+	GPIO_RISING_EDGE = 0,
+	GPIO_FALLING_EDGE = 1,
+	GPIO_EITHER_EDGE = 2
+};
+
+#define GPIO_TIMEOUT	2	//Level an edge callback gets when its timeout passed with no edge, same as pigpio's PI_TIMEOUT
+
+//One step of a hardware-timed waveform, same layout as pigpio's gpioPulse_t
+struct GpioPulse
+{
+	uint32_t on_mask;		//Pins set high at start of step, bit n is pin n
+	uint32_t off_mask;		//Pins set low at start of step
+	uint32_t delay_us;		//Length of step
+};
+
+//Edge callback, same signature as pigpio's gpioISRFunc_t
+typedef void (*GpioEdgeFunc)(int pin, int level, uint32_t tick);
+
+//Everything the program does with GPIO, so it can run on pigpio or on a simulation with no hardware
+//Needs no pigpio headers, so the simulation builds on any Linux box
+class GpioBackend
+{
+public:
+	virtual ~GpioBackend() {}
+
+	/**
+	 ** @brief Starts GPIO, like gpioInitialise()
+	 **
+	 **	@return < 0 on failure
+	 ***/
+	virtual int initialise() = 0;
+
+	/**
+	 ** @brief Stops GPIO, like gpioTerminate()
+	 ***/
+	virtual void terminate() = 0;
+
+	virtual int set_mode(int pin, int mode) = 0;
+
+	virtual int set_pull(int pin, int pud) = 0;
+
+	/**
+	 ** @brief Pin must hold a level for steady_us before an edge is reported
+	 ***/
+	virtual int set_glitch_filter(int pin, int steady_us) = 0;
+
+	/**
+	 ** @brief Calls func on its own thread for each edge, like gpioSetISRFunc()
+	 **
+	 ** @param edge GPIO_RISING_EDGE, GPIO_FALLING_EDGE or GPIO_EITHER_EDGE
+	 ** @param timeout_ms Also calls func with level GPIO_TIMEOUT if nothing happens for this long, 0 for never
+	 ***/
+	virtual int set_edge_callback(int pin, int edge, int timeout_ms, GpioEdgeFunc func) = 0;
+
+	virtual int read(int pin) = 0;
+
+	virtual int write(int pin, int level) = 0;
+
+	/**
+	 ** @brief Microseconds on a free-running clock that wraps, like gpioTick()
+	 ***/
+	virtual uint32_t tick() = 0;
+
+	/**
+	 ** @brief Waits for us microseconds, busy waits for short delays like gpioDelay()
+	 ***/
+	virtual void delay(uint32_t us) = 0;
+
+	/**
+	 ** @brief Builds a hardware-timed waveform
+	 **
+	 **	@return Wave id, < 0 on failure
+	 ***/
+	virtual int wave_create(std::vector<GpioPulse> &pulses) = 0;
+
+	/**
+	 ** @brief Sends wave once
+	 **
+	 **	@return < 0 on failure
+	 ***/
+	virtual int wave_send_once(int wave_id) = 0;
+
+	/**
+	 ** @brief Whether a wave is still being sent
+	 ***/
+	virtual bool wave_busy() = 0;
+
+	virtual void wave_stop() = 0;
+
+	virtual void wave_delete(int wave_id) = 0;
+};
@@ -0,0 +1,163 @@
+#include "ImageSaver.h"
+
+#include <fstream>
+
+ImageSaver::ImageSaver()
+{
+	_running = false;
+	_pending = 0;
+}
+
+ImageSaver::~ImageSaver()
+{
+	stop();
+}
+
+//Starts worker threads
+void ImageSaver::start(int thread_count, int jpeg_quality)
+{
+	if (_running)
+	{
+		return;
+	}
+
+	_encode_params.clear();
+	_encode_params.push_back(cv::IMWRITE_JPEG_QUALITY);
+	_encode_params.push_back(jpeg_quality);
+
+	_running = true;
+
+	for (int thread_ind = 0; thread_ind < thread_count; thread_ind++)
+	{
+		_threads.push_back(std::thread(&ImageSaver::_save_images_thread, this));
+	}
+}
+
+//Finishes every queued image, then joins worker threads
+void ImageSaver::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+	}
+	_jobs_cv.notify_all();
+
+	for (int thread_ind = 0; thread_ind < (int)_threads.size(); thread_ind++)
+	{
+		_threads[thread_ind].join();
+	}
+
+	_threads.clear();
+}
+
+//Queues image to be encoded and written
+void ImageSaver::save(int group, const std::string &path, const std::string &file_name, cv::Mat &image)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		_jobs.push_back(SaveJob());
+		_jobs.back().group = group;
+		_jobs.back().path = path;
+		_jobs.back().file_name = file_name;
+
+		//Hand frame over without copying, give caller a buffer a worker is done with
+		cv::swap(_jobs.back().image, image);
+
+		if (_spare.empty() == false)
+		{
+			cv::swap(image, _spare.back());
+			_spare.pop_back();
+		}
+
+		_pending++;
+	}
+	_jobs_cv.notify_one();
+}
+
+//Takes result of a finished save
+bool ImageSaver::pop_result(SaveResult &result)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_results.empty())
+	{
+		return false;
+	}
+
+	result = _results.front();
+	_results.pop_front();
+
+	return true;
+}
+
+//Images queued or being saved
+int ImageSaver::pending()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _pending;
+}
+
+//Worker loop
+void ImageSaver::_save_images()
+{
+	std::vector<uchar> buffer;
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true)
+	{
+		//Sleep until there's an image, keep going after stop() until queue is empty
+		_jobs_cv.wait(lock, [this]() { return _jobs.empty() == false || _running == false; });
+
+		if (_jobs.empty())
+		{
+			break;
+		}
+
+		SaveJob job;
+		std::swap(job, _jobs.front());
+		_jobs.pop_front();
+
+		//Encode and write without holding the lock so other workers and save() aren't blocked
+		lock.unlock();
+
+		SaveResult result;
+		result.group = job.group;
+		result.file_name = job.file_name;
+
+		//Encode to memory first so encode and SD card write are timed separately
+		double encode_timer = cv::getTickCount();
+		size_t ext_pos = job.file_name.rfind('.');
+		result.saved = cv::imencode(ext_pos == std::string::npos ? ".jpg" : job.file_name.substr(ext_pos), job.image, buffer, _encode_params);
+		result.encode_time = 1000 * (cv::getTickCount() - encode_timer) / cv::getTickFrequency();
+
+		double write_timer = cv::getTickCount();
+
+		if (result.saved)
+		{
+			std::ofstream out_file(job.path + job.file_name, std::ios::binary);
+			out_file.write((const char*) buffer.data(), buffer.size());
+			out_file.close();
+
+			result.saved = out_file.good();
+		}
+
+		result.write_time = 1000 * (cv::getTickCount() - write_timer) / cv::getTickFrequency();
+
+		lock.lock();
+
+		//Frame buffer goes back to the next save() call
+		_spare.push_back(cv::Mat());
+		cv::swap(_spare.back(), job.image);
+
+		_results.push_back(result);
+		_pending--;
+	}
+}
+
+//Start thread for _save_images
+void ImageSaver::_save_images_thread(ImageSaver* ptr)
+{
+	ptr->_save_images();
+}
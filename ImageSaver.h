@@ -0,0 +1,94 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+#define IMAGE_SAVER_THREADS		2		//Worker threads encoding and writing pictures
+#define IMAGE_SAVER_JPEG_QUALITY 95		//JPEG quality of saved pictures
+
+//Outcome of one saved image
+struct SaveResult
+{
+	int group;
+	std::string file_name;
+	bool saved;
+	double encode_time;		//ms
+	double write_time;		//ms
+};
+
+class ImageSaver
+{
+public:
+	ImageSaver();
+	~ImageSaver();
+
+	/**
+	 ** @brief Starts worker threads, does nothing if already running
+	 **
+	 ** @param thread_count Number of images encoded and written at once
+	 ** @param jpeg_quality Quality passed to cv::imencode
+	 ***/
+	void start(int thread_count = IMAGE_SAVER_THREADS, int jpeg_quality = IMAGE_SAVER_JPEG_QUALITY);
+
+	/**
+	 ** @brief Finishes every queued image, then joins worker threads
+	 ***/
+	void stop();
+
+	/**
+	 ** @brief Queues image to be encoded and written, never waits on the workers
+	 **
+	 ** Image is swapped out rather than copied, caller gets back a spare buffer from an earlier save (or an empty Mat)
+	 **
+	 ** @param group Id handed back in the result, i.e. picture number
+	 ** @param path Folder to write to, ending in '/'
+	 ** @param file_name File name, extension picks the format
+	 ** @param image Frame to save, swapped with a spare buffer
+	 ***/
+	void save(int group, const std::string &path, const std::string &file_name, cv::Mat &image);
+
+	/**
+	 ** @brief Takes result of a finished save, in order of completion
+	 **
+	 **	@return false if no save has finished since last call
+	 ***/
+	bool pop_result(SaveResult &result);
+
+	/**
+	 ** @brief Images queued or being saved
+	 ***/
+	int pending();
+
+private:
+	struct SaveJob
+	{
+		int group;
+		std::string path;
+		std::string file_name;
+		cv::Mat image;
+	};
+
+	std::vector<std::thread> _threads;
+	bool _running;
+	std::vector<int> _encode_params;
+
+	//Jobs, results and buffers given back by workers, protected by _mutex
+	std::mutex _mutex;
+	std::condition_variable _jobs_cv;
+	std::deque<SaveJob> _jobs;
+	std::deque<SaveResult> _results;
+	std::vector<cv::Mat> _spare;
+	int _pending;
+
+	//Worker loop
+	void _save_images();
+
+	//Creates thread for _save_images
+	static void _save_images_thread(ImageSaver* ptr);
+};
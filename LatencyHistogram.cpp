@@ -0,0 +1,66 @@
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+	reset();
+}
+
+//Empties histogram
+void LatencyHistogram::reset()
+{
+	std::fill(_buckets, _buckets + LATENCY_BUCKETS, 0);
+	_count = 0;
+	_sum_us = 0;
+	_max_us = 0;
+}
+
+//Latency that fraction of recorded values are at or below
+double LatencyHistogram::percentile(double fraction) const
+{
+	if (_count == 0)
+	{
+		return 0;
+	}
+
+	//Nearest rank, at least the first value
+	uint64_t rank = std::max((uint64_t)1, (uint64_t)(fraction * _count + 0.999999));
+	uint64_t seen = 0;
+
+	for (int bucket_ind = 0; bucket_ind < LATENCY_BUCKETS; bucket_ind++)
+	{
+		seen += _buckets[bucket_ind];
+
+		//Bucket edge can be past anything actually recorded
+		if (seen >= rank)
+		{
+			return std::min(_bucket_top(bucket_ind), (uint64_t)_max_us) / 1000.0;
+		}
+	}
+
+	return max();
+}
+
+//One log line for histogram
+std::string LatencyHistogram::report(const std::string &name) const
+{
+	std::stringstream report_ss;
+
+	report_ss << name << " (" << _count << " frames) p50: " << percentile(0.5) << "ms, p90: " << percentile(0.9) << "ms, p99: " << percentile(0.99)
+		<< "ms, max: " << max() << "ms, average: " << mean() << "ms\n";
+
+	return report_ss.str();
+}
+
+//Largest microseconds value that lands in bucket
+uint64_t LatencyHistogram::_bucket_top(int bucket)
+{
+	if (bucket < LATENCY_SUB_COUNT)
+	{
+		return bucket;
+	}
+
+	int shift = bucket / LATENCY_SUB_COUNT - 1;
+	uint64_t sub = bucket % LATENCY_SUB_COUNT + LATENCY_SUB_COUNT;
+
+	return ((sub + 1) << shift) - 1;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <sstream>
+#include <algorithm>
+
+#define LATENCY_SUB_BITS	4									//Buckets per doubling is 2^this, so values are within ~6% of their bucket
+#define LATENCY_SUB_COUNT	(1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS		((32 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_COUNT)	//Enough to hold any uint32_t microseconds
+
+//Fixed-size log-linear histogram of latencies, recording is a few integer ops and never allocates
+//Only one thread may record, read results once it has stopped
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	/**
+	 ** @brief Empties histogram
+	 ***/
+	void reset();
+
+	/**
+	 ** @brief Adds one latency
+	 **
+	 ** @param ms Latency in milliseconds, negative counts as 0
+	 ***/
+	void record(double ms)
+	{
+		uint32_t us = (ms > 0) ? (ms < 4294967.0 ? (uint32_t)(ms * 1000) : UINT32_MAX) : 0;
+
+		_buckets[_bucket_of(us)]++;
+		_count++;
+		_sum_us += us;
+		_max_us = std::max(_max_us, us);
+	}
+
+	/**
+	 ** @brief Number of latencies recorded
+	 ***/
+	uint64_t count() const
+	{
+		return _count;
+	}
+
+	/**
+	 ** @brief Latency (ms) that fraction of recorded values are at or below, upper edge of its bucket
+	 **
+	 ** @param fraction i.e. 0.99 for p99
+	 ***/
+	double percentile(double fraction) const;
+
+	double mean() const
+	{
+		return (_count > 0) ? _sum_us / 1000.0 / _count : 0;
+	}
+
+	double max() const
+	{
+		return _max_us / 1000.0;
+	}
+
+	/**
+	 ** @brief One log line: count, p50, p90, p99, max and mean
+	 **
+	 ** @param name What was measured, i.e. "Encode time"
+	 ***/
+	std::string report(const std::string &name) const;
+
+private:
+	uint32_t _buckets[LATENCY_BUCKETS];
+	uint64_t _count;
+	uint64_t _sum_us;
+	uint32_t _max_us;
+
+	//Values under LATENCY_SUB_COUNT get a bucket each, above that each doubling is split into LATENCY_SUB_COUNT buckets
+	static int _bucket_of(uint32_t us)
+	{
+		if (us < LATENCY_SUB_COUNT)
+		{
+			return us;
+		}
+
+		int shift = (31 - __builtin_clz(us)) - LATENCY_SUB_BITS;
+
+		return (shift + 1) * LATENCY_SUB_COUNT + (int)(us >> shift) - LATENCY_SUB_COUNT;
+	}
+
+	//Largest microseconds value that lands in bucket
+	static uint64_t _bucket_top(int bucket);
+};
@@ -0,0 +1,221 @@
+#include "LedController.h"
+
+LedController::LedController()
+{
+	_gpio = NULL;
+	_running = false;
+	_wheel_pos = 0;
+	_scheduled = 0;
+}
+
+LedController::~LedController()
+{
+	stop();
+}
+
+//Starts LED thread
+void LedController::start(GpioBackend *gpio)
+{
+	if (_running)
+	{
+		return;
+	}
+
+	_gpio = gpio;
+
+	_wheel.assign(LED_WHEEL_SLOTS, std::vector<LedEvent>());
+	_wheel_pos = 0;
+	_scheduled = 0;
+
+	_running = true;
+	_thread = std::thread(&LedController::_run_leds_thread, this);
+}
+
+//Stops LED thread and turns off every LED it has driven
+void LedController::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+	}
+	_request_cv.notify_one();
+
+	if (_thread.joinable())
+	{
+		_thread.join();
+	}
+
+	for (std::map<int, uint32_t>::iterator pin_it = _generations.begin(); pin_it != _generations.end(); pin_it++)
+	{
+		_gpio->write(pin_it->first, 0);
+	}
+
+	_generations.clear();
+}
+
+//Queues a pattern for an LED
+void LedController::show(int pin, int pattern, int code)
+{
+	LedRequest request;
+	request.pin = pin;
+	request.pattern = pattern;
+	request.code = code;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_requests.push_back(request);
+	}
+	_request_cv.notify_one();
+}
+
+//Puts events for a request on the wheel
+void LedController::_schedule_pattern(const LedRequest &request)
+{
+	//Anything still on the wheel for this pin is from an older request
+	uint32_t generation = ++_generations[request.pin];
+
+	switch (request.pattern)
+	{
+	case LED_PATTERN_OFF:
+		_schedule(request.pin, 0, 0, generation);
+		break;
+
+	case LED_PATTERN_ON:
+		_schedule(request.pin, 1, 0, generation);
+		break;
+
+	//Blink twice
+	case LED_PATTERN_SUCCESS:
+		_schedule(request.pin, 1, 0, generation);
+		_schedule(request.pin, 0, LED_BLINK_MS, generation);
+		_schedule(request.pin, 1, 2 * LED_BLINK_MS, generation);
+		_schedule(request.pin, 0, 3 * LED_BLINK_MS, generation);
+		break;
+
+	//Blink code times, pause, then again so it can be counted
+	case LED_PATTERN_ERROR:
+	{
+		int delay_ms = 0;
+
+		for (int repeat_ind = 0; repeat_ind < 2; repeat_ind++)
+		{
+			for (int blink_ind = 0; blink_ind < request.code; blink_ind++)
+			{
+				_schedule(request.pin, 1, delay_ms, generation);
+				_schedule(request.pin, 0, delay_ms + LED_ERROR_BLINK_MS, generation);
+				delay_ms += 2 * LED_ERROR_BLINK_MS;
+			}
+
+			delay_ms += LED_ERROR_GAP_MS;
+		}
+		break;
+	}
+
+	default:
+		break;
+	}
+}
+
+//Puts one pin change on the wheel
+void LedController::_schedule(int pin, int level, int delay_ms, uint32_t generation)
+{
+	//Nothing to wait for
+	if (delay_ms <= 0)
+	{
+		_gpio->write(pin, level);
+		return;
+	}
+
+	int ticks = (delay_ms + LED_TICK_MS - 1) / LED_TICK_MS;
+
+	LedEvent event;
+	event.pin = pin;
+	event.level = level;
+	event.rounds = (ticks - 1) / LED_WHEEL_SLOTS;
+	event.generation = generation;
+
+	_wheel[(_wheel_pos + ticks) % LED_WHEEL_SLOTS].push_back(event);
+	_scheduled++;
+}
+
+//Fires events in current slot and moves wheel on one tick
+void LedController::_advance_wheel()
+{
+	_wheel_pos = (_wheel_pos + 1) % LED_WHEEL_SLOTS;
+
+	std::vector<LedEvent> &slot = _wheel[_wheel_pos];
+
+	for (size_t event_ind = 0; event_ind < slot.size();)
+	{
+		LedEvent &event = slot[event_ind];
+
+		//Due on a later trip round the wheel
+		if (event.rounds > 0)
+		{
+			event.rounds--;
+			event_ind++;
+			continue;
+		}
+
+		//Only fire if no newer request for this pin came in
+		if (event.generation == _generations[event.pin])
+		{
+			_gpio->write(event.pin, event.level);
+		}
+
+		//Remove without shifting the rest, order within a slot doesn't matter
+		slot[event_ind] = slot.back();
+		slot.pop_back();
+		_scheduled--;
+	}
+}
+
+//LED thread loop
+void LedController::_run_leds()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	std::chrono::steady_clock::time_point next_tick = std::chrono::steady_clock::now();
+
+	while (_running)
+	{
+		//Nothing on the wheel, sleep until a request comes in
+		if (_scheduled == 0)
+		{
+			_request_cv.wait(lock, [this]() { return _requests.empty() == false || _running == false; });
+			next_tick = std::chrono::steady_clock::now() + std::chrono::milliseconds(LED_TICK_MS);
+		}
+
+		//Otherwise sleep until next tick, new requests still wake us so steady levels change straight away
+		else
+		{
+			_request_cv.wait_until(lock, next_tick, [this]() { return _requests.empty() == false || _running == false; });
+		}
+
+		//Take new requests
+		while (_requests.empty() == false)
+		{
+			LedRequest request = _requests.front();
+			_requests.pop_front();
+
+			lock.unlock();
+			_schedule_pattern(request);
+			lock.lock();
+		}
+
+		//Catch up on every tick that has passed, so blink lengths don't stretch if thread was slow to wake
+		while (_scheduled > 0 && std::chrono::steady_clock::now() >= next_tick)
+		{
+			lock.unlock();
+			_advance_wheel();
+			lock.lock();
+
+			next_tick += std::chrono::milliseconds(LED_TICK_MS);
+		}
+	}
+}
+
+//Start thread for _run_leds
+void LedController::_run_leds_thread(LedController* ptr)
+{
+	ptr->_run_leds();
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <map>
+#include <cstdint>
+
+#include "GpioBackend.h"
+
+#define LED_TICK_MS			10		//Resolution (ms) of LED timer wheel
+#define LED_WHEEL_SLOTS		128		//Slots in timer wheel, longer delays go round more than once
+
+#define LED_BLINK_MS		500		//On/off time of success blinks
+#define LED_ERROR_BLINK_MS	150		//On/off time of error code blinks
+#define LED_ERROR_GAP_MS	600		//Off time between repeats of an error code
+
+//Patterns an LED can show
+enum
+{
+	LED_PATTERN_OFF,		//Steady off
+	LED_PATTERN_ON,			//Steady on, i.e. recording indicator
+	LED_PATTERN_SUCCESS,	//Two slow blinks
+	LED_PATTERN_ERROR		//Code is number of fast blinks, shown twice
+};
+
+class LedController
+{
+public:
+	LedController();
+	~LedController();
+
+	/**
+	 ** @brief Starts LED thread, GPIO must already be initialized
+	 **
+	 ** @param gpio Where LED pins are driven
+	 ***/
+	void start(GpioBackend *gpio);
+
+	/**
+	 ** @brief Stops LED thread and turns off every LED it has driven
+	 ***/
+	void stop();
+
+	/**
+	 ** @brief Queues a pattern for an LED, never blocks on the LED thread
+	 **
+	 ** Replaces whatever the LED was showing, so overlapping requests never fight over a pin
+	 **
+	 ** @param pin Output pin of LED
+	 ** @param pattern One of LED_PATTERN_*
+	 ** @param code Number of blinks for LED_PATTERN_ERROR
+	 ***/
+	void show(int pin, int pattern, int code = 1);
+
+private:
+	struct LedRequest
+	{
+		int pin;
+		int pattern;
+		int code;
+	};
+
+	//Pin change due on the wheel, dropped if a newer request for the pin came in since it was scheduled
+	struct LedEvent
+	{
+		int pin;
+		int level;
+		int rounds;
+		uint32_t generation;
+	};
+
+	GpioBackend *_gpio;
+
+	std::thread _thread;
+	bool _running;
+
+	//Requests from other threads, protected by _mutex
+	std::mutex _mutex;
+	std::condition_variable _request_cv;
+	std::deque<LedRequest> _requests;
+
+	//Timer wheel, LED thread only
+	std::vector<std::vector<LedEvent> > _wheel;
+	int _wheel_pos;
+	int _scheduled;
+
+	//Latest request per pin, so older events for that pin are ignored (LED thread only)
+	std::map<int, uint32_t> _generations;
+
+	//Puts events for a request on the wheel
+	void _schedule_pattern(const LedRequest &request);
+
+	//Puts one pin change on the wheel, delay_ms from now
+	void _schedule(int pin, int level, int delay_ms, uint32_t generation);
+
+	//Fires events in current slot and moves wheel on one tick
+	void _advance_wheel();
+
+	//LED thread loop
+	void _run_leds();
+
+	//Creates thread for _run_leds
+	static void _run_leds_thread(LedController* ptr);
+};
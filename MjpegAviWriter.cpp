@@ -0,0 +1,380 @@
+#include "MjpegAviWriter.h"
+
+#define AVIF_HASINDEX			0x10	//avih flag, file has an idx1
+#define AVIIF_KEYFRAME			0x10	//idx1 flag, every MJPEG frame is a keyframe
+#define AVI_INDEX_OF_INDEXES	0x00	//OpenDML super index
+#define AVI_INDEX_OF_CHUNKS		0x01	//OpenDML standard index
+#define AVI_RATE_SCALE			1000	//Frame rate is stored as rate / scale, so fractional fps survive
+#define AVI_DMLH_SIZE			248		//Size of dmlh chunk, only the first field is used
+
+MjpegAviWriter::MjpegAviWriter()
+{
+	_buffer.resize(AVI_BUFFER_SIZE);
+	_failed = false;
+	_fps = 0;
+	_avih_pos = 0;
+	_strh_pos = 0;
+	_indx_pos = 0;
+	_dmlh_pos = 0;
+	_riff_size_pos = 0;
+	_movi_size_pos = 0;
+	_first_riff = true;
+	_frames = 0;
+	_first_riff_frames = 0;
+	_max_frame_bytes = 0;
+}
+
+MjpegAviWriter::~MjpegAviWriter()
+{
+	close();
+}
+
+//Creates file and writes headers
+bool MjpegAviWriter::open(const std::string &path, double fps, cv::Size size)
+{
+	close();
+
+	//Buffer has to be set before the file is opened to take effect
+	_file.rdbuf()->pubsetbuf(&_buffer[0], _buffer.size());
+	_file.open(path, std::ios::binary | std::ios::trunc);
+
+	if (_file.is_open() == false)
+	{
+		return false;
+	}
+
+	_failed = false;
+	_fps = fps;
+	_size = size;
+	_frames = 0;
+	_first_riff_frames = 0;
+	_max_frame_bytes = 0;
+	_first_riff = true;
+
+	_riff_index.clear();
+	_riff_index.reserve(AVI_INDEX_RESERVE);
+	_super_index.clear();
+
+	_start_riff();
+
+	_failed = _file.fail();
+
+	return true;
+}
+
+//Appends one JPEG frame
+bool MjpegAviWriter::write(const std::vector<uchar> &jpeg)
+{
+	if (_file.is_open() == false || jpeg.empty())
+	{
+		return false;
+	}
+
+	uint32_t size = (uint32_t)jpeg.size();
+	uint32_t padded = size + (size & 1);
+	uint64_t entries = _riff_index.size() + 1;
+
+	//RIFF with this frame and the indexes that close it, idx1 only goes in the first one
+	uint64_t riff_bytes = _pos() - _riff_size_pos + 8 + padded + 32 + 8 * entries + (_first_riff ? 8 + 16 * entries : 0);
+
+	if (riff_bytes > AVI_RIFF_MAX_BYTES && _riff_index.empty() == false)
+	{
+		//Current RIFF takes the last super index entry, no room for another
+		if (_super_index.size() + 1 >= AVI_SUPER_INDEX_SIZE)
+		{
+			return false;
+		}
+
+		_finish_riff();
+		_first_riff = false;
+		_start_riff();
+	}
+
+	IndexEntry entry;
+	entry.offset = (uint32_t)(_pos() - (_movi_size_pos + 4));
+	entry.size = size;
+
+	//Size is known up front, so frames never seek back
+	_put_fourcc("00dc");
+	_put32(size);
+	_file.write((const char*)&jpeg[0], size);
+
+	if (size & 1)
+	{
+		_put8(0);
+	}
+
+	_riff_index.push_back(entry);
+	_frames++;
+	_max_frame_bytes = std::max(_max_frame_bytes, size);
+
+	_failed = _failed || _file.fail();
+
+	return _failed == false;
+}
+
+//Writes indexes, fills in header totals and closes file
+bool MjpegAviWriter::close()
+{
+	if (_file.is_open() == false)
+	{
+		return _failed == false;
+	}
+
+	_finish_riff();
+
+	//Main header only counts frames in the first RIFF, dmlh and stream header count all of them
+	_patch32(_avih_pos + 4, (uint32_t)(_max_frame_bytes * _fps));
+	_patch32(_avih_pos + 16, _first_riff_frames);
+	_patch32(_avih_pos + 28, _max_frame_bytes + 8);
+	_patch32(_strh_pos + 32, _frames);
+	_patch32(_strh_pos + 36, _max_frame_bytes + 8);
+	_patch32(_dmlh_pos, _frames);
+
+	//Super index points at each RIFF's standard index
+	_patch32(_indx_pos + 4, (uint32_t)_super_index.size());
+
+	for (size_t entry_ind = 0; entry_ind < _super_index.size(); entry_ind++)
+	{
+		uint64_t entry_pos = _indx_pos + 24 + 16 * entry_ind;
+
+		_patch32(entry_pos, (uint32_t)_super_index[entry_ind].offset);
+		_patch32(entry_pos + 4, (uint32_t)(_super_index[entry_ind].offset >> 32));
+		_patch32(entry_pos + 8, _super_index[entry_ind].size);
+		_patch32(entry_pos + 12, _super_index[entry_ind].duration);
+	}
+
+	_file.close();
+	_failed = _failed || _file.fail();
+
+	return _failed == false;
+}
+
+//Starts a RIFF with its movi list
+void MjpegAviWriter::_start_riff()
+{
+	_put_fourcc("RIFF");
+	_riff_size_pos = _pos();
+	_put32(0);
+	_put_fourcc(_first_riff ? "AVI " : "AVIX");
+
+	if (_first_riff)
+	{
+		uint32_t width = _size.width;
+		uint32_t height = _size.height;
+
+		uint64_t hdrl = _begin_list("hdrl");
+
+		//Main header
+		uint64_t avih = _begin_chunk("avih");
+		_avih_pos = _pos();
+		_put32((uint32_t)round(1000000 / _fps));	//Microseconds per frame
+		_put32(0);									//Max bytes per second, filled in on close
+		_put32(0);									//Padding granularity
+		_put32(AVIF_HASINDEX);
+		_put32(0);									//Frames in first RIFF, filled in on close
+		_put32(0);									//Initial frames
+		_put32(1);									//Streams
+		_put32(0);									//Suggested buffer size, filled in on close
+		_put32(width);
+		_put32(height);
+		_put_zeros(16);
+		_end_chunk(avih);
+
+		uint64_t strl = _begin_list("strl");
+
+		//Stream header
+		uint64_t strh = _begin_chunk("strh");
+		_strh_pos = _pos();
+		_put_fourcc("vids");
+		_put_fourcc("MJPG");
+		_put32(0);									//Flags
+		_put16(0);									//Priority
+		_put16(0);									//Language
+		_put32(0);									//Initial frames
+		_put32(AVI_RATE_SCALE);
+		_put32((uint32_t)round(_fps * AVI_RATE_SCALE));
+		_put32(0);									//Start
+		_put32(0);									//Length in frames, filled in on close
+		_put32(0);									//Suggested buffer size, filled in on close
+		_put32(0xFFFFFFFF);							//Quality, default
+		_put32(0);									//Sample size, frames vary
+		_put16(0);									//Frame rectangle
+		_put16(0);
+		_put16((uint16_t)width);
+		_put16((uint16_t)height);
+		_end_chunk(strh);
+
+		//Stream format, BITMAPINFOHEADER
+		uint64_t strf = _begin_chunk("strf");
+		_put32(40);
+		_put32(width);
+		_put32(height);
+		_put16(1);									//Planes
+		_put16(24);									//Bits per pixel once decoded
+		_put_fourcc("MJPG");
+		_put32(width * height * 3);
+		_put_zeros(16);
+		_end_chunk(strf);
+
+		//OpenDML super index, entries filled in on close
+		uint64_t indx = _begin_chunk("indx");
+		_indx_pos = _pos();
+		_put16(4);									//Longs per entry
+		_put8(0);									//Sub type
+		_put8(AVI_INDEX_OF_INDEXES);
+		_put32(0);									//Entries in use, filled in on close
+		_put_fourcc("00dc");
+		_put_zeros(12);
+		_put_zeros(16 * AVI_SUPER_INDEX_SIZE);
+		_end_chunk(indx);
+
+		_end_chunk(strl);
+
+		//OpenDML extended header, total frames in every RIFF
+		uint64_t odml = _begin_list("odml");
+		uint64_t dmlh = _begin_chunk("dmlh");
+		_dmlh_pos = _pos();
+		_put32(0);
+		_put_zeros(AVI_DMLH_SIZE - 4);
+		_end_chunk(dmlh);
+		_end_chunk(odml);
+
+		_end_chunk(hdrl);
+	}
+
+	_movi_size_pos = _begin_list("movi");
+}
+
+//Writes the RIFF's indexes, then closes its lists
+void MjpegAviWriter::_finish_riff()
+{
+	uint64_t movi_fourcc_pos = _movi_size_pos + 4;
+	uint32_t entries = (uint32_t)_riff_index.size();
+
+	//OpenDML standard index goes at the end of the movi list, offsets point at frame data
+	SuperIndexEntry super_entry;
+	super_entry.offset = _pos();
+	super_entry.duration = entries;
+
+	uint64_t ix = _begin_chunk("ix00");
+	_put16(2);										//Longs per entry
+	_put8(0);										//Sub type
+	_put8(AVI_INDEX_OF_CHUNKS);
+	_put32(entries);
+	_put_fourcc("00dc");
+	_put64(movi_fourcc_pos);						//Base offset
+	_put32(0);
+
+	for (uint32_t entry_ind = 0; entry_ind < entries; entry_ind++)
+	{
+		_put32(_riff_index[entry_ind].offset + 8);
+		_put32(_riff_index[entry_ind].size);
+	}
+
+	_end_chunk(ix);
+
+	super_entry.size = (uint32_t)(_pos() - super_entry.offset);
+	_super_index.push_back(super_entry);
+
+	_end_chunk(_movi_size_pos);
+
+	//AVI 1.0 index for players that don't know OpenDML, they see the first RIFF only
+	if (_first_riff)
+	{
+		uint64_t idx1 = _begin_chunk("idx1");
+
+		for (uint32_t entry_ind = 0; entry_ind < entries; entry_ind++)
+		{
+			_put_fourcc("00dc");
+			_put32(AVIIF_KEYFRAME);
+			_put32(_riff_index[entry_ind].offset);
+			_put32(_riff_index[entry_ind].size);
+		}
+
+		_end_chunk(idx1);
+
+		_first_riff_frames = entries;
+	}
+
+	_end_chunk(_riff_size_pos);
+
+	_riff_index.clear();
+}
+
+//Writes 'LIST' header
+uint64_t MjpegAviWriter::_begin_list(const char *list_type)
+{
+	uint64_t size_pos = _begin_chunk("LIST");
+	_put_fourcc(list_type);
+
+	return size_pos;
+}
+
+//Writes chunk header
+uint64_t MjpegAviWriter::_begin_chunk(const char *fourcc)
+{
+	_put_fourcc(fourcc);
+
+	uint64_t size_pos = _pos();
+	_put32(0);
+
+	return size_pos;
+}
+
+//Fills in size of chunk or list
+void MjpegAviWriter::_end_chunk(uint64_t size_pos)
+{
+	uint64_t size = _pos() - size_pos - 4;
+
+	if (size & 1)
+	{
+		_put8(0);
+	}
+
+	_patch32(size_pos, (uint32_t)size);
+}
+
+//Overwrites 32 bits at pos
+void MjpegAviWriter::_patch32(uint64_t pos, uint32_t value)
+{
+	uint64_t end_pos = _pos();
+
+	_file.seekp(pos);
+	_put32(value);
+	_file.seekp(end_pos);
+}
+
+void MjpegAviWriter::_put_fourcc(const char *fourcc)
+{
+	_file.write(fourcc, 4);
+}
+
+//Everything is little-endian, same as the Pi
+void MjpegAviWriter::_put8(uint8_t value)
+{
+	_file.write((const char*)&value, 1);
+}
+
+void MjpegAviWriter::_put16(uint16_t value)
+{
+	_file.write((const char*)&value, 2);
+}
+
+void MjpegAviWriter::_put32(uint32_t value)
+{
+	_file.write((const char*)&value, 4);
+}
+
+void MjpegAviWriter::_put64(uint64_t value)
+{
+	_file.write((const char*)&value, 8);
+}
+
+void MjpegAviWriter::_put_zeros(size_t count)
+{
+	for (size_t byte_ind = 0; byte_ind < count; byte_ind++)
+	{
+		_put8(0);
+	}
+}
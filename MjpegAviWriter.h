@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <opencv2/opencv.hpp>
+
+#define AVI_RIFF_MAX_BYTES		(1u << 30)	//Each RIFF is kept under 1GB so 32-bit offsets always fit, later ones are OpenDML AVIX
+#define AVI_SUPER_INDEX_SIZE	256			//RIFFs the OpenDML index has room for (256GB of video)
+#define AVI_BUFFER_SIZE			(1 << 20)	//Bytes buffered before a write hits the file
+#define AVI_INDEX_RESERVE		36000		//Frames of index preallocated (20 minutes at 30fps)
+
+//Writes already-compressed JPEG frames into an MJPEG AVI, no decoding or encoding
+//Files past 1GB use OpenDML (AVI 2.0) so long recordings still play and seek, only one thread may use it
+class MjpegAviWriter
+{
+public:
+	MjpegAviWriter();
+	~MjpegAviWriter();
+
+	/**
+	 ** @brief Creates file and writes headers
+	 **
+	 ** @param path Path of video file
+	 ** @param fps Frame rate stored in the file
+	 ** @param size Width/height of the JPEG frames
+	 **	@return false if file couldn't be created
+	 ***/
+	bool open(const std::string &path, double fps, cv::Size size);
+
+	/**
+	 ** @brief Appends one JPEG frame
+	 **
+	 **	@return false if the write failed or the file is full
+	 ***/
+	bool write(const std::vector<uchar> &jpeg);
+
+	/**
+	 ** @brief Writes indexes, fills in header totals and closes file
+	 **
+	 **	@return false if any write failed
+	 ***/
+	bool close();
+
+	bool is_open()
+	{
+		return _file.is_open();
+	}
+
+private:
+	struct IndexEntry
+	{
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	struct SuperIndexEntry
+	{
+		uint64_t offset;
+		uint32_t size;
+		uint32_t duration;
+	};
+
+	std::ofstream _file;
+	std::vector<char> _buffer;
+	bool _failed;
+
+	double _fps;
+	cv::Size _size;
+
+	//Header fields filled in on close()
+	uint64_t _avih_pos;
+	uint64_t _strh_pos;
+	uint64_t _indx_pos;
+	uint64_t _dmlh_pos;
+
+	//Size fields of current RIFF and its movi list
+	uint64_t _riff_size_pos;
+	uint64_t _movi_size_pos;
+	bool _first_riff;
+
+	//Frames in current RIFF, offsets are from its 'movi' fourcc to the chunk header
+	std::vector<IndexEntry> _riff_index;
+	std::vector<SuperIndexEntry> _super_index;
+
+	uint32_t _frames;
+	uint32_t _first_riff_frames;
+	uint32_t _max_frame_bytes;
+
+	//Starts a RIFF with its movi list, header lists go in the first one
+	void _start_riff();
+
+	//Writes the RIFF's OpenDML index (and idx1 in the first RIFF), then closes its lists
+	void _finish_riff();
+
+	//Writes 'LIST' header, returns position of its size field for _end_chunk
+	uint64_t _begin_list(const char *list_type);
+
+	//Writes chunk header, returns position of its size field for _end_chunk
+	uint64_t _begin_chunk(const char *fourcc);
+
+	//Fills in size of chunk or list started at size_pos, pads to even length
+	void _end_chunk(uint64_t size_pos);
+
+	//Overwrites 32 bits at pos, then carries on at the end of the file
+	void _patch32(uint64_t pos, uint32_t value);
+
+	void _put_fourcc(const char *fourcc);
+	void _put8(uint8_t value);
+	void _put16(uint16_t value);
+	void _put32(uint32_t value);
+	void _put64(uint64_t value);
+	void _put_zeros(size_t count);
+
+	uint64_t _pos()
+	{
+		return (uint64_t)_file.tellp();
+	}
+};
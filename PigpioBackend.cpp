@@ -0,0 +1,29 @@
+#include "PigpioBackend.h"
+
+//Builds a hardware-timed waveform
+int PigpioBackend::wave_create(std::vector<GpioPulse> &pulses)
+{
+	if (pulses.empty())
+	{
+		return -1;
+	}
+
+	_pulses.resize(pulses.size());
+
+	for (size_t pulse_ind = 0; pulse_ind < pulses.size(); pulse_ind++)
+	{
+		_pulses[pulse_ind].gpioOn = pulses[pulse_ind].on_mask;
+		_pulses[pulse_ind].gpioOff = pulses[pulse_ind].off_mask;
+		_pulses[pulse_ind].usDelay = pulses[pulse_ind].delay_us;
+	}
+
+	//Start from an empty wave, otherwise pulses get added to whatever was built last
+	gpioWaveAddNew();
+
+	if (gpioWaveAddGeneric(_pulses.size(), &_pulses[0]) < 0)
+	{
+		return -1;
+	}
+
+	return gpioWaveCreate();
+}
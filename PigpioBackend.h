@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include <pigpio.h>
+
+#include "GpioBackend.h"
+
+static_assert(GPIO_INPUT == PI_INPUT && GPIO_OUTPUT == PI_OUTPUT, "GPIO modes must match pigpio's");
+static_assert(GPIO_PUD_OFF == PI_PUD_OFF && GPIO_PUD_DOWN == PI_PUD_DOWN && GPIO_PUD_UP == PI_PUD_UP, "GPIO pulls must match pigpio's");
+static_assert(GPIO_RISING_EDGE == RISING_EDGE && GPIO_FALLING_EDGE == FALLING_EDGE && GPIO_EITHER_EDGE == EITHER_EDGE, "GPIO edges must match pigpio's");
+static_assert(GPIO_TIMEOUT == PI_TIMEOUT, "GPIO timeout level must match pigpio's");
+
+//Real GPIO on the Pi, every call goes straight to pigpio
+class PigpioBackend : public GpioBackend
+{
+public:
+	int initialise()
+	{
+		return gpioInitialise();
+	}
+
+	void terminate()
+	{
+		gpioTerminate();
+	}
+
+	int set_mode(int pin, int mode)
+	{
+		return gpioSetMode(pin, mode);
+	}
+
+	int set_pull(int pin, int pud)
+	{
+		return gpioSetPullUpDown(pin, pud);
+	}
+
+	int set_glitch_filter(int pin, int steady_us)
+	{
+		return gpioGlitchFilter(pin, steady_us);
+	}
+
+	int set_edge_callback(int pin, int edge, int timeout_ms, GpioEdgeFunc func)
+	{
+		return gpioSetISRFunc(pin, edge, timeout_ms, func);
+	}
+
+	int read(int pin)
+	{
+		return gpioRead(pin);
+	}
+
+	int write(int pin, int level)
+	{
+		return gpioWrite(pin, level);
+	}
+
+	uint32_t tick()
+	{
+		return gpioTick();
+	}
+
+	void delay(uint32_t us)
+	{
+		gpioDelay(us);
+	}
+
+	int wave_create(std::vector<GpioPulse> &pulses);
+
+	int wave_send_once(int wave_id)
+	{
+		return gpioWaveTxSend(wave_id, PI_WAVE_MODE_ONE_SHOT);
+	}
+
+	bool wave_busy()
+	{
+		return gpioWaveTxBusy() != 0;
+	}
+
+	void wave_stop()
+	{
+		gpioWaveTxStop();
+	}
+
+	void wave_delete(int wave_id)
+	{
+		gpioWaveDelete(wave_id);
+	}
+
+private:
+	//Pulses in pigpio's type, kept between waves so building one doesn't allocate
+	std::vector<gpioPulse_t> _pulses;
+};
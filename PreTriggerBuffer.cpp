@@ -0,0 +1,162 @@
+#include "PreTriggerBuffer.h"
+
+PreTriggerBuffer::PreTriggerBuffer()
+{
+	_ring = NULL;
+	_cursor = 0;
+	_running = false;
+	_seconds = 0;
+	_memory_budget = 0;
+	_bytes = 0;
+	_evicted = 0;
+}
+
+PreTriggerBuffer::~PreTriggerBuffer()
+{
+	stop();
+}
+
+//Starts compressing every frame from ring into memory
+void PreTriggerBuffer::start(FrameRing *ring, double seconds, size_t memory_budget, int jpeg_quality)
+{
+	stop();
+
+	_ring = ring;
+	_seconds = seconds;
+	_memory_budget = memory_budget;
+
+	_encode_params.clear();
+	_encode_params.push_back(cv::IMWRITE_JPEG_QUALITY);
+	_encode_params.push_back(jpeg_quality);
+
+	//Only buffer frames from now on
+	_cursor = _ring->head();
+
+	_running = true;
+	_thread = std::thread(&PreTriggerBuffer::_compress_frames_thread, this);
+}
+
+//Stops worker thread
+void PreTriggerBuffer::stop()
+{
+	_running = false;
+
+	if (_thread.joinable())
+	{
+		_thread.join();
+	}
+}
+
+//Throws away all buffered frames
+void PreTriggerBuffer::clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_frames.clear();
+	_bytes = 0;
+}
+
+//Takes the oldest buffered frame
+bool PreTriggerBuffer::pop(CompressedFrame &frame)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_frames.empty())
+	{
+		return false;
+	}
+
+	frame.data.swap(_frames.front().data);
+	frame.info = _frames.front().info;
+
+	_bytes -= frame.data.size();
+	_frames.pop_front();
+
+	return true;
+}
+
+//Current buffered length in seconds
+double PreTriggerBuffer::buffered_seconds()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_frames.empty())
+	{
+		return 0;
+	}
+
+	return _frames.back().info.timestamp - _frames.front().info.timestamp;
+}
+
+//Worker loop
+void PreTriggerBuffer::_compress_frames()
+{
+	CompressedFrame frame;
+	uint64_t prev_index = _cursor;
+
+	while (_running)
+	{
+		if (_ring->wait(_cursor, PRETRIGGER_POLL_TIMEOUT) == false)
+		{
+			continue;
+		}
+
+		while (_running)
+		{
+			//Reuse buffer of an evicted frame
+			if (frame.data.capacity() == 0 && _spare.empty() == false)
+			{
+				frame.data.swap(_spare.back());
+				_spare.pop_back();
+			}
+
+			//Camera's own JPEG is kept as it is, otherwise compress the frame here
+			if (_ring->compressed())
+			{
+				if (_ring->read_compressed(_cursor, frame.data, frame.info) == false)
+				{
+					break;
+				}
+			}
+			else
+			{
+				if (_ring->read(_cursor, _image, frame.info) == false)
+				{
+					break;
+				}
+
+				cv::imencode(".jpg", _image, frame.data, _encode_params);
+			}
+
+			//Fell behind and ring overwrote frames before we got to them
+			if (frame.info.index != prev_index + 1 && prev_index != 0)
+			{
+				_evicted += frame.info.index - prev_index - 1;
+			}
+			prev_index = frame.info.index;
+
+			std::lock_guard<std::mutex> lock(_mutex);
+
+			_bytes += frame.data.size();
+			_frames.push_back(CompressedFrame());
+			_frames.back().data.swap(frame.data);
+			_frames.back().info = frame.info;
+
+			//Evict oldest frames until buffer fits in time and memory budget
+			while (_frames.size() > 1 && (_bytes > _memory_budget || _frames.back().info.timestamp - _frames.front().info.timestamp > _seconds))
+			{
+				_bytes -= _frames.front().data.size();
+				_spare.push_back(std::vector<uchar>());
+				_spare.back().swap(_frames.front().data);
+				_frames.pop_front();
+				_evicted++;
+			}
+		}
+	}
+}
+
+//Start thread for _compress_frames
+void PreTriggerBuffer::_compress_frames_thread(PreTriggerBuffer* ptr)
+{
+	ptr->_compress_frames();
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameRing.h"
+
+#define PRETRIGGER_POLL_TIMEOUT	100		//Time (ms) worker waits on ring before checking if it should stop
+
+class PreTriggerBuffer
+{
+public:
+	PreTriggerBuffer();
+	~PreTriggerBuffer();
+
+	/**
+	 ** @brief Starts compressing every frame from ring into memory, oldest frames are evicted to stay in budget
+	 **
+	 ** @param ring Frame ring to read from, must not be re-initialized while running
+	 ** @param seconds Max length of footage kept
+	 ** @param memory_budget Max bytes of compressed frames kept
+	 ** @param jpeg_quality Quality passed to cv::imencode
+	 ***/
+	void start(FrameRing *ring, double seconds, size_t memory_budget, int jpeg_quality);
+
+	/**
+	 ** @brief Stops worker thread, buffered frames are kept until popped or clear()
+	 ***/
+	void stop();
+
+	/**
+	 ** @brief Throws away all buffered frames
+	 ***/
+	void clear();
+
+	bool is_running()
+	{
+		return _running;
+	}
+
+	/**
+	 ** @brief Takes the oldest buffered frame (thread safe, worker keeps filling while frames are popped)
+	 **
+	 **	@return false if buffer is empty
+	 ***/
+	bool pop(CompressedFrame &frame);
+
+	/**
+	 ** @brief Frames evicted (or skipped because ring lapped worker) since last reset_stats()
+	 ***/
+	int evicted()
+	{
+		return _evicted;
+	}
+
+	/**
+	 ** @brief Current buffered length in seconds
+	 ***/
+	double buffered_seconds();
+
+	void reset_stats()
+	{
+		_evicted = 0;
+	}
+
+private:
+	FrameRing *_ring;
+	uint64_t _cursor;
+
+	std::thread _thread;
+	std::atomic<bool> _running;
+
+	//Limits
+	double _seconds;
+	size_t _memory_budget;
+	std::vector<int> _encode_params;
+
+	//Buffered frames and their total size, protected by _mutex
+	std::mutex _mutex;
+	std::deque<CompressedFrame> _frames;
+	size_t _bytes;
+
+	//Buffers of evicted frames, reused so steady state doesn't allocate (worker thread only)
+	std::vector<std::vector<uchar> > _spare;
+
+	std::atomic<int> _evicted;
+
+	//Worker's copy of frame from ring
+	cv::Mat _image;
+
+	//Worker loop
+	void _compress_frames();
+
+	//Creates thread for _compress_frames
+	static void _compress_frames_thread(PreTriggerBuffer* ptr);
+};
@@ -0,0 +1,471 @@
+#include "RawFrameFile.h"
+
+RawFrameWriter::RawFrameWriter()
+{
+	_fd = -1;
+	_failed = false;
+	memset(&_header, 0, sizeof(_header));
+	_page_size = sysconf(_SC_PAGESIZE);
+	_allocated = 0;
+	_window = NULL;
+	_window_start = 0;
+	_window_frames = 0;
+}
+
+RawFrameWriter::~RawFrameWriter()
+{
+	close();
+}
+
+//Creates file, writes header and preallocates room for reserve_frames frames
+bool RawFrameWriter::open(const std::string &path, double fps, cv::Size size, int type, uint64_t reserve_frames)
+{
+	close();
+
+	_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+	if (_fd < 0)
+	{
+		return false;
+	}
+
+	//Header and every slot take whole pages, so any window of frames can be mapped on its own
+	uint64_t frame_bytes = (uint64_t)size.area() * CV_ELEM_SIZE(type);
+
+	memset(&_header, 0, sizeof(_header));
+	memcpy(_header.magic, RAW_MAGIC, sizeof(_header.magic));
+	_header.version = RAW_VERSION;
+	_header.header_size = ((sizeof(RawFileHeader) + _page_size - 1) / _page_size) * _page_size;
+	_header.width = size.width;
+	_header.height = size.height;
+	_header.type = type;
+	_header.frame_bytes = frame_bytes;
+	_header.slot_bytes = ((frame_bytes + _page_size - 1) / _page_size) * _page_size;
+	_header.fps = fps;
+
+	_failed = false;
+	_allocated = 0;
+	_window = NULL;
+	_window_start = 0;
+	_window_frames = std::max<uint64_t>(1, RAW_WINDOW_BYTES / _header.slot_bytes);
+
+	_index.clear();
+	_index.reserve(reserve_frames);
+
+	//Claim the disk space now, so a full SD card shows up before recording rather than partway through
+	bool header_written = pwrite(_fd, &_header, sizeof(_header), 0) == (ssize_t)sizeof(_header);
+
+	if (frame_bytes == 0 || header_written == false || _allocate(_header.header_size + reserve_frames * _header.slot_bytes) == false)
+	{
+		::close(_fd);
+		_fd = -1;
+		unlink(path.c_str());
+
+		return false;
+	}
+
+	return true;
+}
+
+//Copies frame into its slot
+bool RawFrameWriter::write(const cv::Mat &image, const FrameInfo &info)
+{
+	cv::Mat slot = _next_slot();
+
+	if (slot.empty() || image.size() != slot.size() || image.type() != slot.type())
+	{
+		return false;
+	}
+
+	image.copyTo(slot);
+	_commit(info);
+
+	return true;
+}
+
+//Decodes JPEG frame straight into its slot
+bool RawFrameWriter::write_jpeg(const std::vector<uchar> &jpeg, const FrameInfo &info)
+{
+	cv::Mat slot = _next_slot();
+
+	if (slot.empty())
+	{
+		return false;
+	}
+
+	//Decoder writes into the slot if the JPEG matches the file, otherwise it allocates and the result gets checked
+	cv::Mat decoded = slot;
+	cv::imdecode(jpeg, (_header.type == CV_8UC1) ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR, &decoded);
+
+	if (decoded.data != slot.data)
+	{
+		if (decoded.size() != slot.size() || decoded.type() != slot.type())
+		{
+			return false;
+		}
+
+		decoded.copyTo(slot);
+	}
+
+	_commit(info);
+
+	return true;
+}
+
+//Writes index after the last frame, trims unused preallocation, fills in header and closes file
+bool RawFrameWriter::close()
+{
+	if (_fd < 0)
+	{
+		return _failed == false;
+	}
+
+	_unmap_window();
+
+	uint64_t frame_count = _index.size();
+	size_t index_bytes = _index.size() * sizeof(RawIndexEntry);
+
+	_header.frame_count = frame_count;
+	_header.index_offset = _header.header_size + frame_count * _header.slot_bytes;
+
+	if (index_bytes > 0 && pwrite(_fd, &_index[0], index_bytes, _header.index_offset) != (ssize_t)index_bytes)
+	{
+		_failed = true;
+	}
+
+	//Give back preallocated space that wasn't used
+	if (ftruncate(_fd, _header.index_offset + index_bytes) != 0)
+	{
+		_failed = true;
+	}
+
+	//Header goes last, a file cut off before here still has frame_count 0 so readers know there's no index
+	if (pwrite(_fd, &_header, sizeof(_header), 0) != (ssize_t)sizeof(_header))
+	{
+		_failed = true;
+	}
+
+	if (::close(_fd) != 0)
+	{
+		_failed = true;
+	}
+
+	_fd = -1;
+
+	return _failed == false;
+}
+
+//Mat over next frame's slot
+cv::Mat RawFrameWriter::_next_slot()
+{
+	if (_fd < 0)
+	{
+		return cv::Mat();
+	}
+
+	uint64_t frame = _index.size();
+
+	if (_window == NULL || frame >= _window_start + _window_frames)
+	{
+		if (_map_window(frame) == false)
+		{
+			_failed = true;
+			return cv::Mat();
+		}
+	}
+
+	return cv::Mat(_header.height, _header.width, _header.type, _window + (frame - _window_start) * _header.slot_bytes);
+}
+
+//Adds index entry for frame just written to the next slot
+void RawFrameWriter::_commit(const FrameInfo &info)
+{
+	RawIndexEntry entry;
+	entry.offset = _header.header_size + _index.size() * _header.slot_bytes;
+	entry.index = info.index;
+	entry.timestamp = info.timestamp;
+	entry.sequence = info.sequence;
+	entry.led_state = info.led_state;
+
+	_index.push_back(entry);
+}
+
+//Maps window starting at frame first_frame
+bool RawFrameWriter::_map_window(uint64_t first_frame)
+{
+	_unmap_window();
+
+	uint64_t offset = _header.header_size + first_frame * _header.slot_bytes;
+	uint64_t length = _window_frames * _header.slot_bytes;
+
+	//Past the preallocation, grow file by a window
+	if (_allocate(offset + length) == false)
+	{
+		return false;
+	}
+
+	void *window = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, offset);
+
+	if (window == MAP_FAILED)
+	{
+		return false;
+	}
+
+	_window = (uchar*)window;
+	_window_start = first_frame;
+
+	return true;
+}
+
+//Unmaps current window and starts it writing back
+void RawFrameWriter::_unmap_window()
+{
+	if (_window == NULL)
+	{
+		return;
+	}
+
+	uint64_t offset = _header.header_size + _window_start * _header.slot_bytes;
+	uint64_t length = _window_frames * _header.slot_bytes;
+
+	munmap(_window, length);
+	_window = NULL;
+
+	//Start writeback now instead of when the kernel gets round to it, so dirty pages don't pile up in the Pi's RAM
+	sync_file_range(_fd, offset, length, SYNC_FILE_RANGE_WRITE);
+
+	//Window before has had a whole window of frames to reach the card, nothing will read it back so drop it from cache
+	if (offset >= _header.header_size + length)
+	{
+		posix_fadvise(_fd, offset - length, length, POSIX_FADV_DONTNEED);
+	}
+}
+
+//Claims disk space up to end of file offset
+bool RawFrameWriter::_allocate(uint64_t end)
+{
+	if (end <= _allocated)
+	{
+		return true;
+	}
+
+	if (fallocate(_fd, 0, _allocated, end - _allocated) != 0)
+	{
+		//Filesystem can't preallocate, write the space out instead
+		//A sparse file would only run out of room once a mapped page is written back, which is a SIGBUS rather than an error
+		if (errno != EOPNOTSUPP || _zero_fill(_allocated, end) == false)
+		{
+			return false;
+		}
+	}
+
+	_allocated = end;
+
+	return true;
+}
+
+//Writes zeros from start up to end
+bool RawFrameWriter::_zero_fill(uint64_t start, uint64_t end)
+{
+	std::vector<char> zeros(std::min<uint64_t>(RAW_ZERO_FILL_BYTES, end - start), 0);
+
+	while (start < end)
+	{
+		ssize_t written = pwrite(_fd, &zeros[0], std::min<uint64_t>(zeros.size(), end - start), start);
+
+		if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+
+		if (written <= 0)
+		{
+			return false;
+		}
+
+		start += written;
+	}
+
+	return true;
+}
+
+RawFrameReader::RawFrameReader()
+{
+	_fd = -1;
+	_file_size = 0;
+	_page_size = sysconf(_SC_PAGESIZE);
+	_window = NULL;
+	_window_offset = 0;
+	_window_length = 0;
+	_window_start = 0;
+	_window_count = 0;
+	_window_frames = 0;
+	memset(&_header, 0, sizeof(_header));
+	_frames = 0;
+}
+
+RawFrameReader::~RawFrameReader()
+{
+	close();
+}
+
+//Opens file and reads its index
+bool RawFrameReader::open(const std::string &path)
+{
+	close();
+
+	_fd = ::open(path.c_str(), O_RDONLY);
+
+	if (_fd < 0)
+	{
+		return false;
+	}
+
+	struct stat file_stat;
+
+	bool valid = fstat(_fd, &file_stat) == 0
+		&& (uint64_t)file_stat.st_size >= sizeof(RawFileHeader)
+		&& pread(_fd, &_header, sizeof(_header), 0) == (ssize_t)sizeof(_header)
+		&& memcmp(_header.magic, RAW_MAGIC, sizeof(_header.magic)) == 0
+		&& _header.version == RAW_VERSION
+		&& _header.header_size >= sizeof(RawFileHeader)
+		&& _header.frame_bytes == (uint64_t)_header.width * _header.height * CV_ELEM_SIZE(_header.type)
+		&& _header.slot_bytes >= _header.frame_bytes
+		&& _header.frame_bytes > 0;
+
+	if (valid == false)
+	{
+		close();
+		return false;
+	}
+
+	_file_size = file_stat.st_size;
+	_window_frames = std::max<uint64_t>(1, RAW_WINDOW_BYTES / _header.slot_bytes);
+
+	//Index is only there if recording was closed properly, it's small enough to keep in memory
+	uint64_t frames_end = _header.header_size + _header.frame_count * _header.slot_bytes;
+	uint64_t index_bytes = _header.frame_count * sizeof(RawIndexEntry);
+
+	if (_header.frame_count > 0 && _header.index_offset == frames_end && frames_end + index_bytes <= _file_size)
+	{
+		_entries.resize(_header.frame_count);
+
+		if (pread(_fd, &_entries[0], index_bytes, _header.index_offset) == (ssize_t)index_bytes)
+		{
+			_frames = _header.frame_count;
+		}
+		else
+		{
+			_entries.clear();
+		}
+	}
+
+	//Cut off (or index unreadable), every whole slot on disk is a frame (slots preallocated but never written read as black)
+	if (_frames == 0 && _file_size > _header.header_size)
+	{
+		_frames = (_file_size - _header.header_size) / _header.slot_bytes;
+	}
+
+	if (_frames == 0)
+	{
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void RawFrameReader::close()
+{
+	_unmap_window();
+
+	if (_fd >= 0)
+	{
+		::close(_fd);
+		_fd = -1;
+	}
+
+	_file_size = 0;
+	_frames = 0;
+	_entries.clear();
+}
+
+//Frame n, straight from the mapping
+cv::Mat RawFrameReader::frame(uint64_t n)
+{
+	if (_fd < 0 || n >= _frames)
+	{
+		return cv::Mat();
+	}
+
+	if (_window == NULL || n < _window_start || n >= _window_start + _window_count)
+	{
+		if (_map_window(n) == false)
+		{
+			return cv::Mat();
+		}
+	}
+
+	uint64_t offset = _header.header_size + n * _header.slot_bytes;
+
+	return cv::Mat(_header.height, _header.width, _header.type, _window + (offset - _window_offset));
+}
+
+//Index entry of frame n
+bool RawFrameReader::entry(uint64_t n, RawIndexEntry &entry)
+{
+	if (_entries.empty() || n >= _frames)
+	{
+		return false;
+	}
+
+	entry = _entries[n];
+
+	return true;
+}
+
+//Maps window of frames starting at frame first_frame
+bool RawFrameReader::_map_window(uint64_t first_frame)
+{
+	_unmap_window();
+
+	uint64_t count = std::min(_window_frames, _frames - first_frame);
+	uint64_t start = _header.header_size + first_frame * _header.slot_bytes;
+	uint64_t end = std::min(start + count * _header.slot_bytes, _file_size);
+
+	//Writer's slots are page-aligned, but a file from a machine with smaller pages may not be on this one's
+	uint64_t offset = (start / _page_size) * _page_size;
+	size_t length = end - offset;
+
+	void *window = mmap(NULL, length, PROT_READ, MAP_SHARED, _fd, offset);
+
+	if (window == MAP_FAILED)
+	{
+		return false;
+	}
+
+	_window = (uchar*)window;
+	_window_offset = offset;
+	_window_length = length;
+	_window_start = first_frame;
+	_window_count = count;
+
+	//Replay reads frames in order
+	madvise(_window, _window_length, MADV_SEQUENTIAL);
+
+	return true;
+}
+
+//Unmaps current window
+void RawFrameReader::_unmap_window()
+{
+	if (_window == NULL)
+	{
+		return;
+	}
+
+	munmap(_window, _window_length);
+	_window = NULL;
+	_window_length = 0;
+	_window_count = 0;
+}
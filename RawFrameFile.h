@@ -0,0 +1,218 @@
+#pragma once
+
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameRing.h"
+
+#define RAW_MAGIC			"FISHRAW "	//First 8 bytes of every raw video file
+#define RAW_VERSION			1			//Bump when header or index layout changes
+#define RAW_FILE_EXTENSION	".raw"		//Extension of raw videos, also how replay recognises them
+#define RAW_WINDOW_BYTES	(64 << 20)	//Bytes of file mapped at once while writing, so long recordings fit a 32-bit address space
+#define RAW_RESERVE_SECONDS	30			//Seconds of frames preallocated when a raw video is opened
+#define RAW_ZERO_FILL_BYTES	(1 << 20)	//Bytes of zeros written at once when filesystem can't preallocate
+
+//Start of raw video file, padded to header_size, frame n starts at header_size + n * slot_bytes
+struct RawFileHeader
+{
+	char magic[8];				//RAW_MAGIC, not null terminated
+	uint32_t version;			//RAW_VERSION
+	uint32_t header_size;		//Offset of first frame, a whole number of pages
+	uint32_t width;
+	uint32_t height;
+	int32_t type;				//OpenCV type of frames, i.e. CV_8UC3 (BGR)
+	uint32_t frame_bytes;		//Bytes of pixels in each frame, rows are packed
+	uint64_t slot_bytes;		//Bytes between frames, frame_bytes rounded up to a whole page
+	uint64_t frame_count;		//Frames in file, 0 if recording was cut off before close()
+	uint64_t index_offset;		//Offset of index, straight after the last frame (0 if cut off)
+	double fps;					//Frame rate stored in the file
+};
+
+//Trailing index, one entry per frame in file order
+struct RawIndexEntry
+{
+	uint64_t offset;			//Offset of frame's first byte
+	uint64_t index;				//Frame ring index, gaps mean frames the recorder missed
+	double timestamp;			//Capture time (seconds, cv::getTickCount() clock)
+	uint32_t sequence;			//Camera driver's frame counter
+	int32_t led_state;			//Flash LEDs during exposure: 1 on, 0 off, -1 if they switched mid-exposure
+};
+
+static_assert(sizeof(RawFileHeader) == 64, "Raw header layout changed, bump RAW_VERSION");
+static_assert(sizeof(RawIndexEntry) == 32, "Raw index layout changed, bump RAW_VERSION");
+
+//Writes uncompressed frames into a preallocated, memory-mapped file of fixed-size slots, with an index of timestamps and offsets at the end
+//Frames are copied (or decoded) straight into the mapping, nothing goes through a stream buffer. Only one thread may use it
+class RawFrameWriter
+{
+public:
+	RawFrameWriter();
+	~RawFrameWriter();
+
+	/**
+	 ** @brief Creates file, writes header and preallocates room for reserve_frames frames
+	 **
+	 ** @param path Path of raw video file
+	 ** @param fps Frame rate stored in the file
+	 ** @param size Width/height of every frame
+	 ** @param type OpenCV type of every frame
+	 ** @param reserve_frames Frames of disk space claimed up front, file grows past it a window at a time
+	 **	@return false if file couldn't be created or there isn't room for reserve_frames
+	 ***/
+	bool open(const std::string &path, double fps, cv::Size size, int type, uint64_t reserve_frames);
+
+	/**
+	 ** @brief Copies frame into its slot
+	 **
+	 **	@return false if frame doesn't match the file or the disk is full
+	 ***/
+	bool write(const cv::Mat &image, const FrameInfo &info);
+
+	/**
+	 ** @brief Decodes JPEG frame straight into its slot
+	 **
+	 **	@return false if frame couldn't be decoded to the file's size and type, or the disk is full
+	 ***/
+	bool write_jpeg(const std::vector<uchar> &jpeg, const FrameInfo &info);
+
+	/**
+	 ** @brief Writes index after the last frame, trims unused preallocation, fills in header and closes file
+	 **
+	 **	@return false if any write failed
+	 ***/
+	bool close();
+
+	bool is_open()
+	{
+		return _fd >= 0;
+	}
+
+	/**
+	 ** @brief Frames written since open()
+	 ***/
+	uint64_t frames()
+	{
+		return _index.size();
+	}
+
+private:
+	int _fd;
+	bool _failed;
+
+	RawFileHeader _header;
+	size_t _page_size;
+
+	//Bytes of file claimed with fallocate so far
+	uint64_t _allocated;
+
+	//Window of file currently mapped, holds frames [_window_start, _window_start + _window_frames)
+	uchar *_window;
+	uint64_t _window_start;
+	uint64_t _window_frames;
+
+	std::vector<RawIndexEntry> _index;
+
+	//Mat over next frame's slot, mapping the next window first if needed (empty if that failed)
+	cv::Mat _next_slot();
+
+	//Adds index entry for frame just written to the next slot
+	void _commit(const FrameInfo &info);
+
+	//Maps window starting at frame first_frame, claiming disk space for it if needed
+	bool _map_window(uint64_t first_frame);
+
+	//Unmaps current window and starts it writing back, pages of the window before are dropped from cache
+	void _unmap_window();
+
+	//Claims disk space up to end of file offset
+	bool _allocate(uint64_t end);
+
+	//Writes zeros from start up to end, claiming the space where fallocate isn't supported
+	bool _zero_fill(uint64_t start, uint64_t end);
+};
+
+//Reads a raw video written by RawFrameWriter, frames are handed out straight from the mapped file
+//Only a window of frames is mapped at a time, so recordings bigger than a 32-bit address space can be read
+class RawFrameReader
+{
+public:
+	RawFrameReader();
+	~RawFrameReader();
+
+	/**
+	 ** @brief Opens file and reads its index, a file whose recording was cut off is read without its index
+	 **
+	 **	@return false if file isn't a raw video
+	 ***/
+	bool open(const std::string &path);
+
+	void close();
+
+	bool is_open()
+	{
+		return _fd >= 0;
+	}
+
+	/**
+	 ** @brief Number of frames in file
+	 ***/
+	uint64_t frames()
+	{
+		return _frames;
+	}
+
+	cv::Size size()
+	{
+		return cv::Size(_header.width, _header.height);
+	}
+
+	double fps()
+	{
+		return _header.fps;
+	}
+
+	/**
+	 ** @brief Frame n, no copy is made so it's only valid until the next frame() or close()
+	 ***/
+	cv::Mat frame(uint64_t n);
+
+	/**
+	 ** @brief Index entry of frame n
+	 **
+	 **	@return false if file has no index
+	 ***/
+	bool entry(uint64_t n, RawIndexEntry &entry);
+
+private:
+	int _fd;
+	uint64_t _file_size;
+	size_t _page_size;
+
+	RawFileHeader _header;
+	uint64_t _frames;
+	std::vector<RawIndexEntry> _entries;
+
+	//Window of file currently mapped, holds frames [_window_start, _window_start + _window_count)
+	uchar *_window;
+	uint64_t _window_offset;	//File offset of _window, rounded down to a page
+	size_t _window_length;
+	uint64_t _window_start;
+	uint64_t _window_count;
+	uint64_t _window_frames;	//Frames in a full window
+
+	//Maps window of frames starting at frame first_frame
+	bool _map_window(uint64_t first_frame);
+
+	void _unmap_window();
+};
@@ -0,0 +1,274 @@
+#include "SimulatedGpio.h"
+
+SimulatedGpio::SimulatedGpio()
+{
+	_next_wave_id = 0;
+	_wave_end = 0;
+	_running = false;
+	_trace.reserve(SIM_TRACE_RESERVE);
+}
+
+SimulatedGpio::~SimulatedGpio()
+{
+	terminate();
+}
+
+//Starts edge thread
+int SimulatedGpio::initialise()
+{
+	if (_running)
+	{
+		return 0;
+	}
+
+	_running = true;
+	_edge_thread = std::thread(&SimulatedGpio::_fire_edges_thread, this);
+
+	return 0;
+}
+
+//Stops edge thread, injected edges that haven't happened yet are dropped
+void SimulatedGpio::terminate()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+	}
+	_edge_cv.notify_one();
+
+	if (_edge_thread.joinable())
+	{
+		_edge_thread.join();
+	}
+}
+
+//Pull up leaves an unconnected input high, like a released button
+int SimulatedGpio::set_pull(int pin, int pud)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_levels[pin] = (pud == GPIO_PUD_UP) ? 1 : 0;
+
+	return 0;
+}
+
+int SimulatedGpio::set_edge_callback(int pin, int edge, int timeout_ms, GpioEdgeFunc func)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	EdgeCallback callback;
+	callback.edge = edge;
+	callback.func = func;
+	_callbacks[pin] = callback;
+
+	return 0;
+}
+
+int SimulatedGpio::read(int pin)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _levels[pin];
+}
+
+int SimulatedGpio::write(int pin, int level)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_record(pin, level, cv::getTickCount() / cv::getTickFrequency());
+
+	return 0;
+}
+
+//Microseconds on the same clock as the trace, wraps like pigpio's tick
+uint32_t SimulatedGpio::tick()
+{
+	return (uint32_t)(uint64_t)(1000000 * cv::getTickCount() / cv::getTickFrequency());
+}
+
+int SimulatedGpio::wave_create(std::vector<GpioPulse> &pulses)
+{
+	if (pulses.empty())
+	{
+		return -1;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_waves[_next_wave_id] = pulses;
+
+	return _next_wave_id++;
+}
+
+//Logs the wave's transitions at the times DMA would make them
+int SimulatedGpio::wave_send_once(int wave_id)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_waves.count(wave_id) == 0)
+	{
+		return -1;
+	}
+
+	std::vector<GpioPulse> &pulses = _waves[wave_id];
+	double time = cv::getTickCount() / cv::getTickFrequency();
+
+	for (size_t pulse_ind = 0; pulse_ind < pulses.size(); pulse_ind++)
+	{
+		for (int pin = 0; pin < 32; pin++)
+		{
+			if (pulses[pulse_ind].on_mask & (1u << pin))
+			{
+				_record(pin, 1, time);
+			}
+
+			if (pulses[pulse_ind].off_mask & (1u << pin))
+			{
+				_record(pin, 0, time);
+			}
+		}
+
+		time += pulses[pulse_ind].delay_us / 1000000.0;
+	}
+
+	_wave_end = time;
+
+	return 0;
+}
+
+bool SimulatedGpio::wave_busy()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return cv::getTickCount() / cv::getTickFrequency() < _wave_end;
+}
+
+void SimulatedGpio::wave_stop()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_wave_end = 0;
+}
+
+void SimulatedGpio::wave_delete(int wave_id)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_waves.erase(wave_id);
+}
+
+//Changes an input's level after a delay
+void SimulatedGpio::inject_edge(int pin, int level, double delay_seconds)
+{
+	InjectedEdge edge;
+	edge.time = cv::getTickCount() / cv::getTickFrequency() + delay_seconds;
+	edge.pin = pin;
+	edge.level = level;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_edges.push_back(edge);
+	}
+	_edge_cv.notify_one();
+}
+
+//Writes every transition so far as CSV
+bool SimulatedGpio::write_trace(const std::string &path)
+{
+	std::vector<GpioTransition> trace;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		trace = _trace;
+	}
+
+	//Wave transitions are logged ahead of time, so sort everything into order
+	std::stable_sort(trace.begin(), trace.end(), [](const GpioTransition &a, const GpioTransition &b) { return a.time < b.time; });
+
+	std::ofstream out_file(path);
+
+	out_file << "time,pin,level\n";
+	out_file.precision(6);
+	out_file << std::fixed;
+
+	for (size_t transition_ind = 0; transition_ind < trace.size(); transition_ind++)
+	{
+		out_file << trace[transition_ind].time << "," << trace[transition_ind].pin << "," << trace[transition_ind].level << "\n";
+	}
+
+	out_file.close();
+
+	return out_file.good();
+}
+
+//Logs level change, _mutex must be held
+void SimulatedGpio::_record(int pin, int level, double time)
+{
+	//Only actual changes are transitions
+	if (_levels.count(pin) && _levels[pin] == level)
+	{
+		return;
+	}
+
+	_levels[pin] = level;
+
+	GpioTransition transition;
+	transition.time = time;
+	transition.pin = pin;
+	transition.level = level;
+	_trace.push_back(transition);
+}
+
+//Edge thread loop
+void SimulatedGpio::_fire_edges()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (_running)
+	{
+		if (_edges.empty())
+		{
+			_edge_cv.wait(lock);
+			continue;
+		}
+
+		//Earliest injected edge
+		std::vector<InjectedEdge>::iterator next = std::min_element(_edges.begin(), _edges.end(), [](const InjectedEdge &a, const InjectedEdge &b) { return a.time < b.time; });
+		double wait_time = next->time - cv::getTickCount() / cv::getTickFrequency();
+
+		//Not due yet, new edges may come in before it
+		if (wait_time > 0)
+		{
+			_edge_cv.wait_for(lock, std::chrono::microseconds((int64_t)(1000000 * wait_time)));
+			continue;
+		}
+
+		InjectedEdge edge = *next;
+		_edges.erase(next);
+
+		int prev_level = _levels.count(edge.pin) ? _levels[edge.pin] : 1;
+		_record(edge.pin, edge.level, cv::getTickCount() / cv::getTickFrequency());
+
+		//Call back like pigpio would, only for the edges asked for
+		if (_callbacks.count(edge.pin) && prev_level != edge.level)
+		{
+			EdgeCallback callback = _callbacks[edge.pin];
+			bool falling = (edge.level == 0);
+
+			if (callback.edge == GPIO_EITHER_EDGE || (callback.edge == GPIO_FALLING_EDGE && falling) || (callback.edge == GPIO_RISING_EDGE && falling == false))
+			{
+				uint32_t edge_tick = tick();
+
+				lock.unlock();
+				callback.func(edge.pin, edge.level, edge_tick);
+				lock.lock();
+			}
+		}
+	}
+}
+
+//Start thread for _fire_edges
+void SimulatedGpio::_fire_edges_thread(SimulatedGpio* ptr)
+{
+	ptr->_fire_edges();
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <fstream>
+
+#include <opencv2/opencv.hpp>
+
+#include "GpioBackend.h"
+
+#define SIM_TRACE_RESERVE	100000	//Transitions preallocated for trace so logging doesn't allocate mid-run
+
+//One logged change of a pin's level
+struct GpioTransition
+{
+	double time;	//Seconds, cv::getTickCount() clock (same as frame timestamps)
+	int pin;
+	int level;
+};
+
+//GPIO with no hardware: logs every pin transition with a timestamp and can inject button edges
+//Edge callbacks run on the simulation's own thread like pigpio's, timeouts (GPIO_TIMEOUT) are never sent
+class SimulatedGpio : public GpioBackend
+{
+public:
+	SimulatedGpio();
+	~SimulatedGpio();
+
+	int initialise();
+
+	void terminate();
+
+	int set_mode(int pin, int mode)
+	{
+		return 0;
+	}
+
+	int set_pull(int pin, int pud);
+
+	int set_glitch_filter(int pin, int steady_us)
+	{
+		return 0;
+	}
+
+	int set_edge_callback(int pin, int edge, int timeout_ms, GpioEdgeFunc func);
+
+	int read(int pin);
+
+	int write(int pin, int level);
+
+	uint32_t tick();
+
+	void delay(uint32_t us)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(us));
+	}
+
+	int wave_create(std::vector<GpioPulse> &pulses);
+
+	/**
+	 ** @brief Logs the wave's transitions at the times DMA would make them
+	 ***/
+	int wave_send_once(int wave_id);
+
+	bool wave_busy();
+
+	void wave_stop();
+
+	void wave_delete(int wave_id);
+
+	/**
+	 ** @brief Changes an input's level after a delay, calling its edge callback like a real edge would
+	 **
+	 ** @param pin Input pin, i.e. a button
+	 ** @param level Level to go to (buttons are pulled up, so 0 is pressed)
+	 ** @param delay_seconds Time from now to the edge
+	 ***/
+	void inject_edge(int pin, int level, double delay_seconds = 0);
+
+	/**
+	 ** @brief Writes every transition so far as CSV (time, pin, level), oldest first
+	 **
+	 **	@return false if file couldn't be written
+	 ***/
+	bool write_trace(const std::string &path);
+
+private:
+	struct EdgeCallback
+	{
+		int edge;
+		GpioEdgeFunc func;
+	};
+
+	struct InjectedEdge
+	{
+		double time;
+		int pin;
+		int level;
+	};
+
+	//Pin levels, callbacks, trace and waves, protected by _mutex
+	std::mutex _mutex;
+	std::map<int, int> _levels;
+	std::map<int, EdgeCallback> _callbacks;
+	std::vector<GpioTransition> _trace;
+	std::map<int, std::vector<GpioPulse> > _waves;
+	int _next_wave_id;
+	double _wave_end;
+
+	//Edges waiting to happen, fired by edge thread
+	std::condition_variable _edge_cv;
+	std::vector<InjectedEdge> _edges;
+	std::thread _edge_thread;
+	bool _running;
+
+	//Logs level change, _mutex must be held
+	void _record(int pin, int level, double time);
+
+	//Edge thread loop
+	void _fire_edges();
+
+	//Creates thread for _fire_edges
+	static void _fire_edges_thread(SimulatedGpio* ptr);
+};
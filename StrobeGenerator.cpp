@@ -0,0 +1,131 @@
+#include "StrobeGenerator.h"
+
+StrobeGenerator::StrobeGenerator()
+{
+	_gpio = NULL;
+	_pin = -1;
+	_pulse_width_us = 0;
+	_delay_us = 0;
+	_pattern_pos = 0;
+	_wave_id = -1;
+	_overruns = 0;
+	_send_failures = 0;
+}
+
+StrobeGenerator::~StrobeGenerator()
+{
+	stop();
+}
+
+//Builds the pulse waveform
+bool StrobeGenerator::configure(int pin, int pulse_width_us, int delay_us, const std::string &pattern)
+{
+	//Rebuilding a wave is slow, only do it when something changed
+	if (_wave_id >= 0 && pin == _pin && pulse_width_us == _pulse_width_us && delay_us == _delay_us && pattern == _pattern)
+	{
+		return true;
+	}
+
+	stop();
+
+	_pin = pin;
+	_pulse_width_us = pulse_width_us;
+	_delay_us = delay_us;
+	_pattern = pattern;
+	_pattern_pos = 0;
+	_overruns = 0;
+	_send_failures = 0;
+
+	std::vector<GpioPulse> pulses;
+	_build_pulses(pulses);
+
+	_wave_id = _gpio->wave_create(pulses);
+
+	return _wave_id >= 0;
+}
+
+//Call once per frame, sends the pulse if the pattern says this frame gets one
+bool StrobeGenerator::trigger(double trigger_time, double &pulse_start, double &pulse_end)
+{
+	if (_wave_id < 0 || _next_in_pattern() == false)
+	{
+		return false;
+	}
+
+	//Previous pulse hasn't finished, frames are coming faster than delay + width
+	if (_gpio->wave_busy())
+	{
+		_overruns++;
+		return false;
+	}
+
+	if (_gpio->wave_send_once(_wave_id) < 0)
+	{
+		_send_failures++;
+		return false;
+	}
+
+	pulse_start = trigger_time + _delay_us / 1000000.0;
+	pulse_end = pulse_start + _pulse_width_us / 1000000.0;
+
+	return true;
+}
+
+//Stops any pulse in progress, drives pin low and frees the wave
+void StrobeGenerator::stop()
+{
+	if (_wave_id < 0)
+	{
+		return;
+	}
+
+	_gpio->wave_stop();
+	_gpio->wave_delete(_wave_id);
+	_wave_id = -1;
+
+	//Pulse may have been cut off while LEDs were on
+	_gpio->write(_pin, 0);
+}
+
+//Works out pulses for the current settings
+void StrobeGenerator::_build_pulses(std::vector<GpioPulse> &pulses)
+{
+	GpioPulse pulse;
+
+	//Wait out the delay with the pin untouched
+	if (_delay_us > 0)
+	{
+		pulse.on_mask = 0;
+		pulse.off_mask = 0;
+		pulse.delay_us = _delay_us;
+		pulses.push_back(pulse);
+	}
+
+	//LEDs on for the pulse width
+	pulse.on_mask = 1 << _pin;
+	pulse.off_mask = 0;
+	pulse.delay_us = _pulse_width_us;
+	pulses.push_back(pulse);
+
+	//LEDs off
+	pulse.on_mask = 0;
+	pulse.off_mask = 1 << _pin;
+	pulse.delay_us = 0;
+	pulses.push_back(pulse);
+}
+
+//Whether the next frame in the pattern gets a pulse, and steps the pattern
+bool StrobeGenerator::_next_in_pattern()
+{
+	//Empty pattern fires on every frame
+	if (_pattern.empty())
+	{
+		return true;
+	}
+
+	bool fire = (_pattern[_pattern_pos] == STROBE_PATTERN_FIRE);
+
+	_pattern_pos = (_pattern_pos + 1) % _pattern.size();
+
+	return fire;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "GpioBackend.h"
+
+#define STROBE_PATTERN_FIRE	'1'		//Character in repeat pattern for frames that get a pulse
+
+class StrobeGenerator
+{
+public:
+	StrobeGenerator();
+	~StrobeGenerator();
+
+	/**
+	 ** @brief GPIO used for waves, must be set before configure()
+	 ***/
+	void set_gpio(GpioBackend *gpio)
+	{
+		_gpio = gpio;
+	}
+
+	/**
+	 ** @brief Builds the pulse waveform, does nothing if settings haven't changed
+	 **
+	 ** @param pin Output pin for flash LEDs
+	 ** @param pulse_width_us How long LEDs stay on per pulse
+	 ** @param delay_us Time from trigger() to start of pulse, timed by DMA so it doesn't jitter
+	 ** @param pattern One character per frame, '1' fires and anything else skips, repeats forever (i.e. "10" pulses every other frame)
+	 **	@return false if pigpio couldn't create the wave
+	 ***/
+	bool configure(int pin, int pulse_width_us, int delay_us, const std::string &pattern);
+
+	/**
+	 ** @brief Call once per frame, sends the pulse if the pattern says this frame gets one
+	 **
+	 ** @param trigger_time Time of call (seconds, cv::getTickCount() clock)
+	 ** @param pulse_start Expected time LEDs turn on, if a pulse was sent
+	 ** @param pulse_end Expected time LEDs turn off, if a pulse was sent
+	 **	@return true if a pulse was sent
+	 ***/
+	bool trigger(double trigger_time, double &pulse_start, double &pulse_end);
+
+	/**
+	 ** @brief Stops any pulse in progress, drives pin low and frees the wave
+	 ***/
+	void stop();
+
+	/**
+	 ** @brief Pulses skipped because the previous one was still running
+	 ***/
+	int overruns()
+	{
+		return _overruns;
+	}
+
+	/**
+	 ** @brief Pulses pigpio refused to send
+	 ***/
+	int send_failures()
+	{
+		return _send_failures;
+	}
+
+	/**
+	 ** @brief Restarts the repeat pattern at its first character
+	 ***/
+	void reset_pattern()
+	{
+		_pattern_pos = 0;
+	}
+
+private:
+	GpioBackend *_gpio;
+
+	int _pin;
+	int _pulse_width_us;
+	int _delay_us;
+	std::string _pattern;
+	size_t _pattern_pos;
+
+	//pigpio wave id, -1 if no wave is built
+	int _wave_id;
+
+	int _overruns;
+	int _send_failures;
+
+	//Works out pulses for the current settings (delay, on, off)
+	void _build_pulses(std::vector<GpioPulse> &pulses);
+
+	//Whether the next frame in the pattern gets a pulse, and steps the pattern
+	bool _next_in_pattern();
+};
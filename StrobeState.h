@@ -0,0 +1,80 @@
+#pragma once
+
+//What the flash LEDs last did while strobing, enough to tell what they were doing during any frame's exposure window
+//Shared by the recorder and bench_pipeline so both tag frames the same way. Only the capture thread may touch it
+struct StrobeState
+{
+	int level;				//LED level set last
+	int prev_level;			//Level before that
+	double switch_time;		//When level last changed (seconds, cv::getTickCount() clock)
+
+	bool pulsing;			//Hardware-timed pulses (LED_PULSE) instead of switching level
+	double pulse_start;		//When last pulse should be on
+	double pulse_end;
+};
+
+/**
+ ** @brief Empties state, LEDs off and never switched
+ ***/
+inline void strobe_reset(StrobeState &state)
+{
+	state.level = 0;
+	state.prev_level = 0;
+	state.switch_time = 0;
+	state.pulsing = false;
+	state.pulse_start = 0;
+	state.pulse_end = 0;
+}
+
+/**
+ ** @brief Notes LEDs switching level
+ **
+ ** @param level New LED level
+ ** @param time When the pin was written (seconds, cv::getTickCount() clock)
+ ***/
+inline void strobe_switched(StrobeState &state, int level, double time)
+{
+	state.prev_level = state.level;
+	state.level = level;
+	state.switch_time = time;
+}
+
+/**
+ ** @brief LED level during an exposure window
+ **
+ ** @param exposure_start Time first row started exposing
+ ** @param exposure_end Time last row finished exposing
+ **	@return 1 lit, 0 unlit, -1 if LEDs switched partway through
+ ***/
+inline int strobe_state_during(const StrobeState &state, double exposure_start, double exposure_end)
+{
+	//Pulse mode - lit only if last pulse falls inside the exposure
+	if (state.pulsing)
+	{
+		if (state.pulse_end <= exposure_start || state.pulse_start >= exposure_end)
+		{
+			return 0;
+		}
+
+		if (state.pulse_start >= exposure_start && state.pulse_end <= exposure_end)
+		{
+			return 1;
+		}
+
+		return -1;
+	}
+
+	//Last switch was before exposure began
+	if (state.switch_time <= exposure_start)
+	{
+		return state.level;
+	}
+
+	//Last switch came after exposure ended
+	if (state.switch_time >= exposure_end)
+	{
+		return state.prev_level;
+	}
+
+	return -1;
+}
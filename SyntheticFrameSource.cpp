@@ -0,0 +1,148 @@
+#include "SyntheticFrameSource.h"
+
+SyntheticFrameSource::SyntheticFrameSource(double fps, double jitter_ms, double exposure_time, uint64_t seed, bool mjpeg)
+{
+	_fps = fps;
+	_jitter = jitter_ms / 1000.0;
+	_exposure_time = exposure_time;
+	_seed = seed;
+	_mjpeg = mjpeg;
+	_open = false;
+	_sequence = 0;
+	_next_time = 0;
+}
+
+//Frames are generated at exactly size
+bool SyntheticFrameSource::open(cv::Size size)
+{
+	if (size.width <= 0 || size.height <= 0 || _fps <= 0)
+	{
+		return false;
+	}
+
+	_size = size;
+	_sequence = 0;
+	_rng = cv::RNG(_seed);
+
+	//Horizontal gradient, so compression and colour conversion have something to chew on
+	_background.create(_size, CV_8UC3);
+
+	for (int col_ind = 0; col_ind < _size.width; col_ind++)
+	{
+		uchar level = (uchar)(255 * col_ind / std::max(1, _size.width - 1));
+		_background.col(col_ind).setTo(cv::Scalar(level, 128, 255 - level));
+	}
+
+	_image.create(_size, CV_8UC3);
+
+	//Encode a loop of frames now, so grabbing costs what a camera's DMA would (nothing)
+	_jpeg_frames.clear();
+
+	if (_mjpeg)
+	{
+		std::vector<int> encode_params;
+		encode_params.push_back(cv::IMWRITE_JPEG_QUALITY);
+		encode_params.push_back(SYNTHETIC_JPEG_QUALITY);
+
+		_jpeg_frames.resize(SYNTHETIC_JPEG_FRAMES);
+
+		for (int frame_ind = 0; frame_ind < SYNTHETIC_JPEG_FRAMES; frame_ind++)
+		{
+			_draw(frame_ind);
+			cv::imencode(".jpg", _image, _jpeg_frames[frame_ind], encode_params);
+		}
+	}
+
+	_next_time = cv::getTickCount() / cv::getTickFrequency();
+	_open = true;
+
+	return true;
+}
+
+//Sleeps until next frame is due, then draws it
+bool SyntheticFrameSource::grab(SourceFrame &frame, int timeout_ms)
+{
+	frame.buffer_index = -1;
+
+	if (_open == false)
+	{
+		return false;
+	}
+
+	double now = cv::getTickCount() / cv::getTickFrequency();
+
+	//Not due within the timeout, act like a camera that hasn't delivered yet
+	if (_next_time - now > timeout_ms / 1000.0)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+		return false;
+	}
+
+	if (_next_time > now)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds((int64_t)(1000000 * (_next_time - now))));
+	}
+
+	if (_mjpeg)
+	{
+		std::vector<uchar> &jpeg = _jpeg_frames[_sequence % SYNTHETIC_JPEG_FRAMES];
+		frame.image = cv::Mat(1, (int)jpeg.size(), CV_8UC1, &jpeg[0]);
+	}
+	else
+	{
+		_draw(_sequence);
+		frame.image = _image;
+	}
+
+	frame.buffer_index = 0;
+	frame.sequence = _sequence++;
+	frame.timestamp = cv::getTickCount() / cv::getTickFrequency();
+	frame.bytes_used = frame.image.total() * frame.image.elemSize();
+	frame.flags = 0;
+	//Exposure window modelled like a rolling-shutter camera's, see V4L2Capture::grab()
+	frame.exposure_start = frame.timestamp - _exposure_time - sensor_readout_time(_size.height, _exposure_time, 1.0 / _fps);
+	frame.exposure_end = frame.timestamp;
+
+	//Next interval, moved by jitter but never less than zero
+	double interval = 1.0 / _fps + (_jitter > 0 ? _rng.uniform(-_jitter, _jitter) : 0);
+	_next_time = std::max(_next_time + std::max(interval, 0.0), frame.timestamp);
+
+	return true;
+}
+
+//Copies frame out
+bool SyntheticFrameSource::convert(const SourceFrame &frame, cv::Mat &image)
+{
+	if (frame.buffer_index < 0 || frame.image.empty())
+	{
+		return false;
+	}
+
+	if (_mjpeg)
+	{
+		cv::imdecode(frame.image, cv::IMREAD_COLOR, &image);
+	}
+	else
+	{
+		frame.image.copyTo(image);
+	}
+
+	return image.empty() == false;
+}
+
+//Nothing to give back, frame is drawn fresh each grab()
+void SyntheticFrameSource::release(SourceFrame &frame)
+{
+	frame.image.release();
+	frame.buffer_index = -1;
+}
+
+//Spot moves across the frame so consecutive frames differ
+void SyntheticFrameSource::_draw(uint32_t sequence)
+{
+	_background.copyTo(_image);
+
+	int radius = std::max(4, _size.height / 20);
+	cv::Point centre(radius + (int)(sequence * 4) % std::max(1, _size.width - 2 * radius), _size.height / 2);
+	cv::circle(_image, centre, radius, cv::Scalar(255, 255, 255), -1);
+}
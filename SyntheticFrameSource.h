@@ -0,0 +1,93 @@
+#pragma once
+
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameSource.h"
+
+#define SYNTHETIC_SEED		12345	//Default RNG seed, same seed gives same jitter every run
+#define SYNTHETIC_JPEG_FRAMES	32		//Distinct frames encoded up front in MJPEG mode, played in a loop
+#define SYNTHETIC_JPEG_QUALITY	90		//Roughly what a camera's MJPEG looks like
+
+//Generates frames (gradient with a moving bright spot) at a set rate with random timing jitter, for benchmarking without a camera
+class SyntheticFrameSource : public FrameSource
+{
+public:
+	/**
+	 ** @param fps Average frame rate
+	 ** @param jitter_ms Each frame interval is moved by up to this much either way
+	 ** @param exposure_time Exposure (seconds) each frame is tagged with
+	 ** @param seed RNG seed for jitter
+	 ** @param mjpeg Deliver JPEG frames like a camera in MJPEG mode, encoded once in open() so grab() costs nothing
+	 ***/
+	SyntheticFrameSource(double fps, double jitter_ms = 0, double exposure_time = 0.01, uint64_t seed = SYNTHETIC_SEED, bool mjpeg = false);
+
+	/**
+	 ** @brief Frames are generated at exactly size
+	 ***/
+	bool open(cv::Size size);
+
+	void close()
+	{
+		_open = false;
+	}
+
+	bool is_open()
+	{
+		return _open;
+	}
+
+	/**
+	 ** @brief Sleeps until next frame is due, then draws it
+	 ***/
+	bool grab(SourceFrame &frame, int timeout_ms);
+
+	bool convert(const SourceFrame &frame, cv::Mat &image);
+
+	void release(SourceFrame &frame);
+
+	bool compressed()
+	{
+		return _mjpeg;
+	}
+
+	cv::Size size()
+	{
+		return _size;
+	}
+
+	void set_exposure_time(double seconds)
+	{
+		_exposure_time = seconds;
+	}
+
+private:
+	double _fps;
+	double _jitter;
+	double _exposure_time;
+	uint64_t _seed;
+	bool _mjpeg;
+	bool _open;
+	cv::Size _size;
+
+	cv::RNG _rng;
+
+	//Gradient drawn once, each frame starts as a copy of it
+	cv::Mat _background;
+	cv::Mat _image;
+
+	//MJPEG mode frames, the nth frame is _jpeg_frames[n % SYNTHETIC_JPEG_FRAMES]
+	std::vector<std::vector<uchar> > _jpeg_frames;
+
+	uint32_t _sequence;
+
+	//When next frame is due (seconds, cv::getTickCount() clock)
+	double _next_time;
+
+	//Draws frame number sequence into _image
+	void _draw(uint32_t sequence);
+};
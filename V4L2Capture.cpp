@@ -0,0 +1,289 @@
+#include "V4L2Capture.h"
+
+V4L2Capture::V4L2Capture(const std::string &device, uint32_t pixel_format, int buffer_count)
+{
+	_device = device;
+	_requested_format = pixel_format;
+	_requested_buffer_count = buffer_count;
+	_fd = -1;
+	_streaming = false;
+	_pixel_format = 0;
+	_bytes_per_line = 0;
+	_exposure_time = 0;
+	_last_timestamp = 0;
+}
+
+V4L2Capture::~V4L2Capture()
+{
+	close();
+}
+
+//Opens device, sets format, mmaps buffers and starts streaming
+bool V4L2Capture::open(const std::string &device, cv::Size size, uint32_t pixel_format, int buffer_count)
+{
+	close();
+
+	_fd = ::open(device.c_str(), O_RDWR | O_NONBLOCK);
+
+	if (_fd < 0)
+	{
+		return false;
+	}
+
+	//Ask for width/height/format, driver writes back what it will actually deliver
+	v4l2_format format = {};
+	format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	format.fmt.pix.width = size.width;
+	format.fmt.pix.height = size.height;
+	format.fmt.pix.pixelformat = pixel_format;
+	format.fmt.pix.field = V4L2_FIELD_NONE;
+
+	if (_xioctl(VIDIOC_S_FMT, &format) < 0)
+	{
+		close();
+		return false;
+	}
+
+	_size = cv::Size(format.fmt.pix.width, format.fmt.pix.height);
+	_pixel_format = format.fmt.pix.pixelformat;
+	_bytes_per_line = format.fmt.pix.bytesperline;
+
+	//Only formats convert() knows about
+	if (_pixel_format != V4L2_PIX_FMT_YUYV && _pixel_format != V4L2_PIX_FMT_BGR24 && _pixel_format != V4L2_PIX_FMT_MJPEG)
+	{
+		close();
+		return false;
+	}
+
+	//Ask driver for mmap buffers
+	v4l2_requestbuffers request = {};
+	request.count = buffer_count;
+	request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	request.memory = V4L2_MEMORY_MMAP;
+
+	if (_xioctl(VIDIOC_REQBUFS, &request) < 0 || request.count < 2)
+	{
+		close();
+		return false;
+	}
+
+	//Map every buffer and queue it up for the driver to fill
+	for (uint32_t buffer_ind = 0; buffer_ind < request.count; buffer_ind++)
+	{
+		v4l2_buffer buffer = {};
+		buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buffer.memory = V4L2_MEMORY_MMAP;
+		buffer.index = buffer_ind;
+
+		if (_xioctl(VIDIOC_QUERYBUF, &buffer) < 0)
+		{
+			close();
+			return false;
+		}
+
+		void *mapped = mmap(NULL, buffer.length, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, buffer.m.offset);
+
+		if (mapped == MAP_FAILED)
+		{
+			close();
+			return false;
+		}
+
+		_buffers.push_back(mapped);
+		_buffer_lengths.push_back(buffer.length);
+
+		if (_xioctl(VIDIOC_QBUF, &buffer) < 0)
+		{
+			close();
+			return false;
+		}
+	}
+
+	//Start stream
+	v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+	if (_xioctl(VIDIOC_STREAMON, &type) < 0)
+	{
+		close();
+		return false;
+	}
+
+	_last_timestamp = 0;
+
+	_streaming = true;
+
+	return true;
+}
+
+//Stops streaming, unmaps buffers and closes device
+void V4L2Capture::close()
+{
+	if (_fd < 0)
+	{
+		return;
+	}
+
+	if (_streaming)
+	{
+		v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		_xioctl(VIDIOC_STREAMOFF, &type);
+		_streaming = false;
+	}
+
+	for (size_t buffer_ind = 0; buffer_ind < _buffers.size(); buffer_ind++)
+	{
+		munmap(_buffers[buffer_ind], _buffer_lengths[buffer_ind]);
+	}
+
+	_buffers.clear();
+	_buffer_lengths.clear();
+
+	//Free kernel buffers
+	v4l2_requestbuffers request = {};
+	request.count = 0;
+	request.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	request.memory = V4L2_MEMORY_MMAP;
+	_xioctl(VIDIOC_REQBUFS, &request);
+
+	::close(_fd);
+	_fd = -1;
+}
+
+//Dequeues next filled buffer
+bool V4L2Capture::grab(SourceFrame &frame, int timeout_ms)
+{
+	frame.buffer_index = -1;
+
+	if (_streaming == false)
+	{
+		return false;
+	}
+
+	//Wait for driver to fill a buffer
+	pollfd poll_fd = {};
+	poll_fd.fd = _fd;
+	poll_fd.events = POLLIN;
+
+	if (poll(&poll_fd, 1, timeout_ms) <= 0)
+	{
+		return false;
+	}
+
+	v4l2_buffer buffer = {};
+	buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buffer.memory = V4L2_MEMORY_MMAP;
+
+	if (_xioctl(VIDIOC_DQBUF, &buffer) < 0)
+	{
+		return false;
+	}
+
+	frame.buffer_index = buffer.index;
+	frame.sequence = buffer.sequence;
+	frame.timestamp = buffer.timestamp.tv_sec + buffer.timestamp.tv_usec / 1000000.0;
+	frame.bytes_used = buffer.bytesused;
+	frame.flags = buffer.flags;
+
+	//Rolling shutter: first row starts exposing a readout before the last row, time between frames only caps the readout
+	double frame_period = (_last_timestamp > 0 && frame.timestamp > _last_timestamp) ? frame.timestamp - _last_timestamp : 0;
+	double exposure_time = _exposure_time;
+	double readout_time = sensor_readout_time(_size.height, exposure_time, frame_period);
+	_last_timestamp = frame.timestamp;
+
+	//Driver says whether timestamp is taken at start of exposure or end of frame (end of frame is the default)
+	if ((buffer.flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) == V4L2_BUF_FLAG_TSTAMP_SRC_SOE)
+	{
+		frame.exposure_start = frame.timestamp;
+		frame.exposure_end = frame.timestamp + exposure_time + readout_time;
+	}
+	else
+	{
+		frame.exposure_start = frame.timestamp - exposure_time - readout_time;
+		frame.exposure_end = frame.timestamp;
+	}
+
+	//Wrap kernel memory without copying
+	void *data = _buffers[buffer.index];
+
+	switch (_pixel_format)
+	{
+	case V4L2_PIX_FMT_MJPEG:
+		frame.image = cv::Mat(1, buffer.bytesused, CV_8UC1, data);
+		break;
+	case V4L2_PIX_FMT_BGR24:
+		frame.image = cv::Mat(_size, CV_8UC3, data, _bytes_per_line);
+		break;
+	case V4L2_PIX_FMT_YUYV:
+	default:
+		frame.image = cv::Mat(_size, CV_8UC2, data, _bytes_per_line);
+		break;
+	}
+
+	//Driver flagged buffer as corrupt, hand it straight back
+	if (buffer.flags & V4L2_BUF_FLAG_ERROR)
+	{
+		release(frame);
+		return false;
+	}
+
+	return true;
+}
+
+//Converts a grabbed frame into a BGR image
+bool V4L2Capture::convert(const SourceFrame &frame, cv::Mat &image)
+{
+	if (frame.buffer_index < 0 || frame.image.empty())
+	{
+		return false;
+	}
+
+	switch (_pixel_format)
+	{
+	case V4L2_PIX_FMT_MJPEG:
+		//Decodes straight into image's memory if it's already the right size
+		cv::imdecode(frame.image, cv::IMREAD_COLOR, &image);
+		break;
+	case V4L2_PIX_FMT_BGR24:
+		frame.image.copyTo(image);
+		break;
+	case V4L2_PIX_FMT_YUYV:
+	default:
+		cv::cvtColor(frame.image, image, cv::COLOR_YUV2BGR_YUYV);
+		break;
+	}
+
+	return image.empty() == false;
+}
+
+//Gives buffer back to the driver
+void V4L2Capture::release(SourceFrame &frame)
+{
+	if (frame.buffer_index < 0)
+	{
+		return;
+	}
+
+	v4l2_buffer buffer = {};
+	buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buffer.memory = V4L2_MEMORY_MMAP;
+	buffer.index = frame.buffer_index;
+
+	_xioctl(VIDIOC_QBUF, &buffer);
+
+	//Header would dangle once driver reuses the buffer
+	frame.image.release();
+	frame.buffer_index = -1;
+}
+
+//ioctl that retries when interrupted by a signal
+int V4L2Capture::_xioctl(unsigned long request, void *arg)
+{
+	int result;
+
+	do
+	{
+		result = ioctl(_fd, request, arg);
+	} while (result == -1 && errno == EINTR);
+
+	return result;
+}
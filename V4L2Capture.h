@@ -0,0 +1,151 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <atomic>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/videodev2.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameSource.h"
+
+#define V4L2_BUFFER_COUNT	4		//Default number of mmap'd kernel buffers
+
+//Live camera, frames are dequeued kernel buffers and image points straight into mmap'd memory
+class V4L2Capture : public FrameSource
+{
+public:
+	/**
+	 ** @brief Sets up which device open(size) uses
+	 **
+	 ** @param device Path of device, i.e. /dev/video0
+	 ** @param pixel_format V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_BGR24 or V4L2_PIX_FMT_MJPEG
+	 ** @param buffer_count Number of kernel buffers to request
+	 ***/
+	V4L2Capture(const std::string &device = "/dev/video0", uint32_t pixel_format = V4L2_PIX_FMT_YUYV, int buffer_count = V4L2_BUFFER_COUNT);
+	~V4L2Capture();
+
+	/**
+	 ** @brief Opens device given to constructor
+	 ***/
+	bool open(cv::Size size)
+	{
+		return open(_device, size, _requested_format, _requested_buffer_count);
+	}
+
+	/**
+	 ** @brief Opens device, sets format, mmaps buffers and starts streaming
+	 **
+	 ** @param device Path of device, i.e. /dev/video0
+	 ** @param size Requested width/height, driver may adjust it (check size() afterwards)
+	 ** @param pixel_format V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_BGR24 or V4L2_PIX_FMT_MJPEG
+	 ** @param buffer_count Number of kernel buffers to request
+	 **	@return true if device is streaming
+	 ***/
+	bool open(const std::string &device, cv::Size size, uint32_t pixel_format = V4L2_PIX_FMT_YUYV, int buffer_count = V4L2_BUFFER_COUNT);
+
+	/**
+	 ** @brief Stops streaming, unmaps buffers and closes device
+	 ***/
+	void close();
+
+	bool is_open()
+	{
+		return _streaming;
+	}
+
+	/**
+	 ** @brief Dequeues next filled buffer (DQBUF), must be handed back with release()
+	 **
+	 ** @param frame Filled with zero-copy header, timestamp and sequence
+	 ** @param timeout_ms Time to wait for the driver
+	 **	@return false on timeout or error
+	 ***/
+	bool grab(SourceFrame &frame, int timeout_ms);
+
+	/**
+	 ** @brief Converts a grabbed frame into a BGR image (reuses image memory if already allocated)
+	 ***/
+	bool convert(const SourceFrame &frame, cv::Mat &image);
+
+	/**
+	 ** @brief True when driver delivers MJPEG
+	 ***/
+	bool compressed()
+	{
+		return _pixel_format == V4L2_PIX_FMT_MJPEG;
+	}
+
+	/**
+	 ** @brief Gives buffer back to the driver (QBUF)
+	 ***/
+	void release(SourceFrame &frame);
+
+	/**
+	 ** @brief Exposure time currently set on the sensor, used to estimate each frame's exposure window
+	 **
+	 ** @param seconds Exposure time in seconds
+	 ***/
+	void set_exposure_time(double seconds)
+	{
+		_exposure_time = seconds;
+	}
+
+	/**
+	 ** @brief File descriptor of device, -1 if not open
+	 ***/
+	int fd()
+	{
+		return _fd;
+	}
+
+	cv::Size size()
+	{
+		return _size;
+	}
+
+	uint32_t pixel_format()
+	{
+		return _pixel_format;
+	}
+
+	int buffer_count()
+	{
+		return (int)_buffers.size();
+	}
+
+private:
+	//Settings for open(size)
+	std::string _device;
+	uint32_t _requested_format;
+	int _requested_buffer_count;
+
+	int _fd;
+	bool _streaming;
+
+	//Format actually chosen by driver
+	cv::Size _size;
+	uint32_t _pixel_format;
+	uint32_t _bytes_per_line;
+
+	//mmap'd kernel buffers
+	std::vector<void*> _buffers;
+	std::vector<size_t> _buffer_lengths;
+
+	//Exposure time in seconds, set from main thread and read in grab()
+	std::atomic<double> _exposure_time;
+
+	//Timestamp of previous frame, time between frames caps the readout time
+	double _last_timestamp;
+
+	//ioctl that retries when interrupted by a signal
+	int _xioctl(unsigned long request, void *arg);
+};
@@ -0,0 +1,449 @@
+#include "VideoEncoder.h"
+
+VideoEncoder::VideoEncoder()
+{
+	_running = false;
+	_passthrough = false;
+	_raw = false;
+	_raw_ok = true;
+	_queue_head = 0;
+	_queue_count = 0;
+	_frames_written = 0;
+	_frames_dropped = 0;
+	_frames_failed = 0;
+	_queue_depth_max = 0;
+	_queue_depth_sum = 0;
+	_prelude = NULL;
+	_prelude_done = true;
+	_prelude_frames = 0;
+	_prelude_last_info.index = 0;
+	_sidecar_ok = true;
+}
+
+VideoEncoder::~VideoEncoder()
+{
+	close();
+}
+
+//Opens video file and starts encoder thread
+bool VideoEncoder::open(const std::string &file_name, int codec, double fps, cv::Size size, bool is_color, const std::string &sidecar_name, int queue_size)
+{
+	//Finish any previous file first
+	close();
+
+	_video.open(file_name, codec, fps, size, is_color);
+
+	if (_video.isOpened() == false)
+	{
+		return false;
+	}
+
+	//Preallocate queue so pushing never allocates
+	_passthrough = false;
+	_raw = false;
+	_queue_data.clear();
+	_queue_images.resize(queue_size);
+
+	for (int slot_ind = 0; slot_ind < queue_size; slot_ind++)
+	{
+		_queue_images[slot_ind].create(size, is_color ? CV_8UC3 : CV_8UC1);
+	}
+
+	_start(fps, sidecar_name, queue_size);
+
+	return true;
+}
+
+//Opens MJPEG AVI for frames that are already compressed
+bool VideoEncoder::open_passthrough(const std::string &file_name, double fps, cv::Size size, const std::string &sidecar_name, int queue_size)
+{
+	close();
+
+	if (_avi.open(file_name, fps, size) == false)
+	{
+		return false;
+	}
+
+	//Reserve a byte per pixel, bigger frames grow their slot once and keep it
+	_passthrough = true;
+	_raw = false;
+	_queue_images.clear();
+	_queue_data.resize(queue_size);
+
+	for (int slot_ind = 0; slot_ind < queue_size; slot_ind++)
+	{
+		_queue_data[slot_ind].reserve(size.area());
+	}
+
+	_start(fps, sidecar_name, queue_size);
+
+	return true;
+}
+
+//Opens raw video for uncompressed frames
+bool VideoEncoder::open_raw(const std::string &file_name, double fps, cv::Size size, int type, bool compressed, const std::string &sidecar_name, int queue_size)
+{
+	close();
+
+	if (_raw_file.open(file_name, fps, size, type, (uint64_t)(fps * RAW_RESERVE_SECONDS)) == false)
+	{
+		return false;
+	}
+
+	//Queue holds frames the way they're pushed, JPEGs are only decoded once they reach the writer thread
+	_passthrough = false;
+	_raw = true;
+	_raw_ok = true;
+	_queue_images.clear();
+	_queue_data.clear();
+
+	if (compressed)
+	{
+		_queue_data.resize(queue_size);
+
+		for (int slot_ind = 0; slot_ind < queue_size; slot_ind++)
+		{
+			_queue_data[slot_ind].reserve(size.area());
+		}
+	}
+	else
+	{
+		_queue_images.resize(queue_size);
+
+		for (int slot_ind = 0; slot_ind < queue_size; slot_ind++)
+		{
+			_queue_images[slot_ind].create(size, type);
+		}
+	}
+
+	_start(fps, sidecar_name, queue_size);
+
+	return true;
+}
+
+//Resets queue and stats, opens sidecar and starts encoder thread
+void VideoEncoder::_start(double fps, const std::string &sidecar_name, int queue_size)
+{
+	//Frame metadata goes alongside, record n describes frame n of the video
+	_sidecar_name = sidecar_name;
+	_sidecar_ok = sidecar_name.empty() || _sidecar.open(sidecar_name, fps);
+
+	_queue_info.resize(queue_size);
+
+	//Reset queue and stats
+	_queue_head = 0;
+	_queue_count = 0;
+	_frames_written = 0;
+	_frames_dropped = 0;
+	_frames_failed = 0;
+	_queue_depth_max = 0;
+	_queue_depth_sum = 0;
+	_encode_histogram.reset();
+	_prelude_histogram.reset();
+	_latency_histogram.reset();
+	_prelude = NULL;
+	_prelude_done = true;
+	_prelude_frames = 0;
+	_prelude_last_info.index = 0;
+
+	//Start encoder thread
+	_running = true;
+	_thread = std::thread(&VideoEncoder::_encode_frames_thread, this);
+}
+
+//Copies frame into queue, never waits on the encoder
+bool VideoEncoder::push(const cv::Mat &image, const FrameInfo &info)
+{
+	int slot;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		//Queue full, encoder is falling behind so drop this frame
+		if (_running == false || _queue_images.empty() || _queue_count == (int)_queue_info.size())
+		{
+			_frames_dropped++;
+			return false;
+		}
+
+		slot = (_queue_head + _queue_count) % _queue_info.size();
+	}
+
+	//Encoder never touches slots past the end of the queue, so copy without holding lock
+	image.copyTo(_queue_images[slot]);
+	_queue_info[slot] = info;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue_count++;
+	}
+	_queue_cv.notify_one();
+
+	return true;
+}
+
+//Copies JPEG frame into queue, never waits on the writer
+bool VideoEncoder::push_compressed(const std::vector<uchar> &data, const FrameInfo &info)
+{
+	int slot;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+
+		if (_running == false || _queue_data.empty() || _queue_count == (int)_queue_info.size())
+		{
+			_frames_dropped++;
+			return false;
+		}
+
+		slot = (_queue_head + _queue_count) % _queue_info.size();
+	}
+
+	_queue_data[slot].assign(data.begin(), data.end());
+	_queue_info[slot] = info;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_queue_count++;
+	}
+	_queue_cv.notify_one();
+
+	return true;
+}
+
+//Writes pre-trigger frames ahead of anything pushed
+void VideoEncoder::write_prelude(PreTriggerBuffer *prelude)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_prelude = prelude;
+		_prelude_done = false;
+	}
+	_queue_cv.notify_one();
+}
+
+//Whether prelude has been written
+bool VideoEncoder::prelude_done(FrameInfo &last_info)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (_prelude_done)
+	{
+		last_info = _prelude_last_info;
+	}
+
+	return _prelude_done;
+}
+
+//Waits for queued frames to be encoded, stops thread and closes file
+void VideoEncoder::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_running = false;
+	}
+	_queue_cv.notify_one();
+
+	if (_thread.joinable())
+	{
+		_thread.join();
+	}
+
+	if (_video.isOpened())
+	{
+		_video.release();
+	}
+
+	if (_avi.is_open())
+	{
+		_avi.close();
+	}
+
+	if (_raw_file.is_open())
+	{
+		_raw_ok = _raw_file.close() && _raw_ok;
+	}
+
+	if (_sidecar.is_open())
+	{
+		_sidecar_ok = _sidecar.close();
+	}
+}
+
+//Encode time and latency percentiles, and totals for the log file
+std::string VideoEncoder::report()
+{
+	std::stringstream report_ss;
+
+	report_ss << "Encoder pre-trigger frames written: " << _prelude_frames << "\n";
+	report_ss << "Encoder frames written: " << _frames_written << "\n";
+	report_ss << "Encoder frames dropped (queue full): " << _frames_dropped << "\n";
+	if (_frames_failed > 0)
+	{
+		report_ss << "WARNING: " << _frames_failed << " frames FAILED to write (disk full or file too big), left out of video and frame metadata\n";
+	}
+	if (_raw && _raw_ok == false)
+	{
+		report_ss << "WARNING: raw video has missing frames or no index, disk full or write failed\n";
+	}
+	if (_sidecar_name.empty() == false)
+	{
+		report_ss << "Frame metadata " << (_sidecar_ok ? "written to " : "FAILED to write to ") << _sidecar_name << " (" << _sidecar.records() << " records)\n";
+	}
+
+	report_ss << "Encoder max queue depth: " << _queue_depth_max << " of " << _queue_info.size() << "\n";
+
+	if (_frames_written > 0)
+	{
+		report_ss << "Encoder average queue depth: " << _queue_depth_sum / _frames_written << "\n";
+	}
+
+	report_ss << _encode_histogram.report(_passthrough ? "Write time (passthrough, no encode)" : (_raw ? "Write time (raw, no encode)" : "Encode time"));
+	report_ss << _latency_histogram.report("Capture to written");
+
+	if (_prelude_frames > 0)
+	{
+		report_ss << _prelude_histogram.report(_passthrough ? "Pre-trigger write time" : (_raw ? "Pre-trigger decode time" : "Pre-trigger decode + encode time"));
+	}
+
+	return report_ss.str();
+}
+
+//Encoder thread loop
+void VideoEncoder::_encode_frames()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (true)
+	{
+		//Pre-trigger frames go first, passthrough writes their JPEG as is, raw decodes them straight into the file, otherwise they're decoded since the writer only takes images
+		if (_prelude != NULL)
+		{
+			PreTriggerBuffer *prelude = _prelude;
+			CompressedFrame frame;
+
+			lock.unlock();
+			bool popped = prelude->pop(frame);
+
+			if (popped)
+			{
+				double encode_timer = cv::getTickCount();
+				bool written = true;
+
+				if (_passthrough)
+				{
+					written = _avi.write(frame.data);
+				}
+				else if (_raw)
+				{
+					written = _raw_file.write_jpeg(frame.data, frame.info);
+					_raw_ok = written && _raw_ok;
+				}
+				else
+				{
+					cv::imdecode(frame.data, cv::IMREAD_COLOR, &_prelude_image);
+					_video.write(_prelude_image);
+				}
+
+				double encode_time = 1000 * (cv::getTickCount() - encode_timer) / cv::getTickFrequency();
+				_prelude_histogram.record(encode_time);
+
+				//Sidecar record n has to stay video frame n, so a frame that didn't make it into the file gets no record
+				if (written)
+				{
+					_sidecar.append(frame.info, true);
+					_frames_written++;
+					_prelude_frames++;
+				}
+				else
+				{
+					_frames_failed++;
+				}
+			}
+			lock.lock();
+
+			if (popped)
+			{
+				_prelude_last_info = frame.info;
+			}
+
+			//Buffer is empty so we've caught up to live frames, or we're closing
+			else
+			{
+				_prelude = NULL;
+				_prelude_done = true;
+			}
+
+			continue;
+		}
+
+		//Sleep until there's a frame, keep going after close() until queue is empty
+		_queue_cv.wait(lock, [this]() { return _queue_count > 0 || _prelude != NULL || _running == false; });
+
+		if (_prelude != NULL)
+		{
+			continue;
+		}
+
+		if (_queue_count == 0)
+		{
+			break;
+		}
+
+		int slot = _queue_head;
+		int queue_depth = _queue_count;
+
+		//Encode without holding the lock so pushes aren't blocked
+		lock.unlock();
+
+		double encode_timer = cv::getTickCount();
+
+		//cv::VideoWriter doesn't say whether a frame made it, only passthrough and raw can be checked
+		bool written = true;
+
+		if (_passthrough)
+		{
+			written = _avi.write(_queue_data[slot]);
+		}
+		else if (_raw)
+		{
+			written = _queue_data.empty() ? _raw_file.write(_queue_images[slot], _queue_info[slot]) : _raw_file.write_jpeg(_queue_data[slot], _queue_info[slot]);
+			_raw_ok = written && _raw_ok;
+		}
+		else
+		{
+			_video.write(_queue_images[slot]);
+		}
+
+		double encode_done = cv::getTickCount();
+		double encode_time = 1000 * (encode_done - encode_timer) / cv::getTickFrequency();
+
+		//Sidecar record n has to stay video frame n, so a frame that didn't make it into the file gets no record
+		if (written)
+		{
+			_sidecar.append(_queue_info[slot], false);
+			_frames_written++;
+		}
+		else
+		{
+			_frames_failed++;
+		}
+
+		//Update stats, slot is still ours so its info can be read without the lock
+		_queue_depth_sum += queue_depth;
+		_queue_depth_max = std::max(_queue_depth_max, queue_depth);
+		_encode_histogram.record(encode_time);
+		_latency_histogram.record(1000 * (encode_done / cv::getTickFrequency() - _queue_info[slot].timestamp));
+
+		//Give slot back to queue
+		lock.lock();
+		_queue_head = (_queue_head + 1) % _queue_info.size();
+		_queue_count--;
+	}
+}
+
+//Start thread for _encode_frames
+void VideoEncoder::_encode_frames_thread(VideoEncoder* ptr)
+{
+	ptr->_encode_frames();
+}
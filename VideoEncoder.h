@@ -0,0 +1,211 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameRing.h"
+#include "PreTriggerBuffer.h"
+#include "LatencyHistogram.h"
+#include "FrameSidecar.h"
+#include "MjpegAviWriter.h"
+#include "RawFrameFile.h"
+
+#define ENCODER_QUEUE_SIZE	16		//Frames that can wait for the encoder before new ones get dropped
+
+class VideoEncoder
+{
+public:
+	VideoEncoder();
+	~VideoEncoder();
+
+	/**
+	 ** @brief Opens video file and starts encoder thread
+	 **
+	 ** @param file_name Path of video file
+	 ** @param codec fourcc of codec
+	 ** @param fps Frame rate stored in the file
+	 ** @param size Size of every frame pushed
+	 ** @param is_color True for CV_8UC3 frames, false for CV_8UC1
+	 ** @param sidecar_name Path of binary per-frame metadata file (see FrameSidecar), empty for none
+	 ** @param queue_size Number of frames preallocated for the queue
+	 **	@return true if video file was opened, video is still recorded if sidecar couldn't be
+	 ***/
+	bool open(const std::string &file_name, int codec, double fps, cv::Size size, bool is_color, const std::string &sidecar_name = "", int queue_size = ENCODER_QUEUE_SIZE);
+
+	/**
+	 ** @brief Opens MJPEG AVI and starts writer thread, frames are pushed already compressed with push_compressed() and never re-encoded
+	 **
+	 ** @param file_name Path of video file
+	 ** @param fps Frame rate stored in the file
+	 ** @param size Size of the JPEG frames
+	 ** @param sidecar_name Path of binary per-frame metadata file (see FrameSidecar), empty for none
+	 ** @param queue_size Number of frames that can wait for the writer
+	 **	@return true if video file was opened
+	 ***/
+	bool open_passthrough(const std::string &file_name, double fps, cv::Size size, const std::string &sidecar_name = "", int queue_size = ENCODER_QUEUE_SIZE);
+
+	/**
+	 ** @brief Opens raw video (see RawFrameWriter) and starts writer thread, frames are stored uncompressed
+	 **
+	 ** @param file_name Path of raw video file
+	 ** @param fps Frame rate stored in the file
+	 ** @param size Size of every frame
+	 ** @param type OpenCV type frames are stored as
+	 ** @param compressed True if frames are pushed as JPEG with push_compressed() (decoded on writer thread), false for push()
+	 ** @param sidecar_name Path of binary per-frame metadata file (see FrameSidecar), empty for none
+	 ** @param queue_size Number of frames that can wait for the writer
+	 **	@return true if file was opened and RAW_RESERVE_SECONDS of frames preallocated
+	 ***/
+	bool open_raw(const std::string &file_name, double fps, cv::Size size, int type, bool compressed, const std::string &sidecar_name = "", int queue_size = ENCODER_QUEUE_SIZE);
+
+	/**
+	 ** @brief Copies frame into queue, never waits on the encoder
+	 **
+	 **	@return false if queue was full and frame was dropped
+	 ***/
+	bool push(const cv::Mat &image, const FrameInfo &info);
+
+	/**
+	 ** @brief Passthrough, or raw opened with compressed frames - copies JPEG frame into queue, never waits on the writer
+	 **
+	 **	@return false if queue was full and frame was dropped
+	 ***/
+	bool push_compressed(const std::vector<uchar> &data, const FrameInfo &info);
+
+	/**
+	 ** @brief Writes pre-trigger frames ahead of anything pushed, call right after open()
+	 **
+	 ** Keeps pulling from the buffer (which keeps filling) until it is empty, i.e. caught up to live
+	 **
+	 ** @param prelude Buffer to take frames from
+	 ***/
+	void write_prelude(PreTriggerBuffer *prelude);
+
+	/**
+	 ** @brief Whether prelude has been written, so live frames can be pushed from here on
+	 **
+	 ** @param last_info Info of last prelude frame written, index is 0 if there was none
+	 ***/
+	bool prelude_done(FrameInfo &last_info);
+
+	/**
+	 ** @brief Waits for queued frames to be encoded, stops thread and closes file
+	 ***/
+	void close();
+
+	/**
+	 ** @brief Whether a file is currently open
+	 ***/
+	bool is_open()
+	{
+		return _running;
+	}
+
+	/**
+	 ** @brief Whether file was opened with open_passthrough()
+	 ***/
+	bool passthrough()
+	{
+		return _passthrough;
+	}
+
+	/**
+	 ** @brief Whether file was opened with open_raw()
+	 ***/
+	bool raw()
+	{
+		return _raw;
+	}
+
+	/**
+	 ** @brief Encode time and latency percentiles, and totals for the log file, only call after close()
+	 ***/
+	std::string report();
+
+	/**
+	 ** @brief Time (ms) from capture to written of live frames, only call after close()
+	 ***/
+	const LatencyHistogram& latency_histogram()
+	{
+		return _latency_histogram;
+	}
+
+	/**
+	 ** @brief Frames written to file (live and pre-trigger), only call after close()
+	 ***/
+	int frames_written()
+	{
+		return _frames_written;
+	}
+
+	/**
+	 ** @brief Frames dropped because queue was full, only call after close()
+	 ***/
+	int frames_dropped()
+	{
+		return _frames_dropped;
+	}
+
+private:
+	//Owned by encoder thread while it's running, passthrough writes JPEG frames into _avi as they are and raw copies pixels into _raw_file
+	cv::VideoWriter _video;
+	MjpegAviWriter _avi;
+	RawFrameWriter _raw_file;
+	bool _passthrough;
+	bool _raw;
+	bool _raw_ok;
+
+	//Encoder thread
+	std::thread _thread;
+	bool _running;
+
+	//Bounded queue of preallocated frames, protected by _mutex, only one of images or data is used depending on how file was opened
+	std::mutex _mutex;
+	std::condition_variable _queue_cv;
+	std::vector<cv::Mat> _queue_images;
+	std::vector<std::vector<uchar> > _queue_data;
+	std::vector<FrameInfo> _queue_info;
+	int _queue_head;
+	int _queue_count;
+
+	//Stats, dropped count is written by pusher and the rest by encoder thread
+	int _frames_written;
+	int _frames_dropped;
+	int _frames_failed;
+	int _queue_depth_max;
+	double _queue_depth_sum;
+
+	//One record per frame written, in file order, owned by encoder thread while it's running
+	FrameSidecar _sidecar;
+	std::string _sidecar_name;
+	bool _sidecar_ok;
+
+	//Per-frame timings, recorded by encoder thread
+	LatencyHistogram _encode_histogram;
+	LatencyHistogram _prelude_histogram;
+	LatencyHistogram _latency_histogram;
+
+	//Pre-trigger frames still to be written, NULL when done (protected by _mutex)
+	PreTriggerBuffer *_prelude;
+	bool _prelude_done;
+	FrameInfo _prelude_last_info;
+	int _prelude_frames;
+	cv::Mat _prelude_image;
+
+	//Resets queue and stats, opens sidecar and starts encoder thread
+	void _start(double fps, const std::string &sidecar_name, int queue_size);
+
+	//Encoder thread loop
+	void _encode_frames();
+
+	//Creates thread for _encode_frames
+	static void _encode_frames_thread(VideoEncoder* ptr);
+};
@@ -0,0 +1,446 @@
+/**
+ * @file bench_pipeline.cpp
+ * @brief Drives the recording path (capture thread -> frame ring -> encoder -> file) with synthetic frames
+ * and prints throughput, latency, drops, CPU time and peak RSS as JSON, so changes can be compared before deploying
+ */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "FrameRing.h"
+#include "VideoEncoder.h"
+#include "SyntheticFrameSource.h"
+#include "FlashDifference.h"
+#include "EyeDetector.h"
+#include "StrobeState.h"
+
+#define BENCH_WIDTH_DEFAULT		640		// pixels
+#define BENCH_HEIGHT_DEFAULT	480		// pixels
+#define BENCH_FPS_DEFAULT		30.0	// frames per second from synthetic source
+#define BENCH_SECONDS_DEFAULT	10.0	// length of run
+#define BENCH_CODEC_DEFAULT		"MJPG"	// fourcc, same codec the camera records with
+#define BENCH_OUTPUT_DEFAULT	"/tmp/bench_pipeline.avi"
+#define BENCH_RAW_OUTPUT_DEFAULT "/tmp/bench_pipeline.raw"	// used instead with --raw
+#define BENCH_SIDECAR_DEFAULT	"/tmp/bench_pipeline_frames.bin"	// per-frame metadata, written like a real recording's
+#define BENCH_EYES_OUTPUT		"/tmp/bench_pipeline_eyes.bin"	// eye detections with --diff
+
+#define BENCH_RING_SIZE			8		// same as FRAME_RING_SIZE in FishTestCamera.h
+#define BENCH_WAIT_TIMEOUT		1000	// ms to wait on capture thread before giving up, same as FRAME_WAIT_TIMEOUT
+#define BENCH_POLL_TIMEOUT		100		// ms capture thread waits on source before checking if it should stop
+#define BENCH_DIFF_THRESHOLD	40		// same as FLASH_DIFF_THRESHOLD in FishTestCamera.h
+#define BENCH_EXPOSURE_DEFAULT	10.0	// ms, same as EXPOSURE_DEFAULT * EXPOSURE_UNIT in FishTestCamera.h
+
+//Settings for one run
+struct BenchConfig
+{
+	cv::Size size;
+	double fps;
+	double jitter_ms;
+	double seconds;
+	double exposure_ms;
+	std::string codec;
+	std::string output;
+	std::string sidecar;
+	bool mjpeg;
+	bool raw;
+	bool diff;
+	bool strobe_check;
+};
+
+//////////FUNCTION PROTOTYPES///////////
+//Reads settings from command line, returns false if arguments don't make sense
+bool parse_args(int argc, char **argv, BenchConfig &config);
+
+//Capture thread - same as FishTestCamera's, strobe switches a simulated LED every frame (LED_STROBE, no phase offset) and tags frames by their exposure window
+void capture_frames(FrameSource *source, FrameRing *ring, std::atomic<bool> *running, bool strobe);
+
+//User and system CPU time of whole process (seconds)
+void cpu_time(double &user, double &system);
+
+//////////FUNCTION DEFINITIONS///////////
+int main(int argc, char **argv)
+{
+	BenchConfig config;
+
+	if (parse_args(argc, argv, config) == false)
+	{
+		std::cerr << "Usage: " << argv[0] << " [--size <width> <height>] [--fps <fps>] [--jitter <ms>] [--codec <fourcc>] [--seconds <seconds>] [--output <video file>] [--sidecar <metadata file, none to skip>] [--exposure <ms>] [--mjpeg] [--raw] [--diff] [--strobe-check]\n";
+		return -1;
+	}
+
+	SyntheticFrameSource source(config.fps, config.jitter_ms, config.exposure_ms / 1000.0, SYNTHETIC_SEED, config.mjpeg);
+
+	if (source.open(config.size) == false)
+	{
+		std::cerr << "Couldn't open synthetic source\n";
+		return -1;
+	}
+
+	//Same ring setup as the camera's: MJPEG frames are kept compressed, anything else is converted to BGR
+	FrameRing ring;
+	ring.init(BENCH_RING_SIZE, source.size(), CV_8UC3, source.compressed() ? source.size().area() * 3 : 0);
+
+	VideoEncoder encoder;
+	int codec = cv::VideoWriter::fourcc(config.codec[0], config.codec[1], config.codec[2], config.codec[3]);
+
+	bool opened;
+
+	if (config.raw)
+	{
+		opened = encoder.open_raw(config.output, config.fps, source.size(), ring.type(), ring.compressed(), config.sidecar);
+	}
+	else if (ring.compressed())
+	{
+		opened = encoder.open_passthrough(config.output, config.fps, source.size(), config.sidecar);
+	}
+	else
+	{
+		opened = encoder.open(config.output, codec, config.fps, source.size(), true, config.sidecar);
+	}
+
+	if (opened == false)
+	{
+		std::cerr << "Couldn't open " << config.output << " with codec " << config.codec << "\n";
+		return -1;
+	}
+
+	double user_start, system_start;
+	cpu_time(user_start, system_start);
+
+	double start_time = cv::getTickCount() / cv::getTickFrequency();
+
+	std::atomic<bool> running(true);
+	bool strobe = config.diff || config.strobe_check;
+	std::thread capture_thread(capture_frames, &source, &ring, &running, strobe);
+
+	//Lit minus unlit on its own thread and eye detection on its workers, like while recording a strobed video
+	FlashDifference flash_difference;
+	EyeDetector eye_detector;
+
+	if (config.diff)
+	{
+		eye_detector.start(BENCH_EYES_OUTPUT);
+		flash_difference.start(&ring, BENCH_DIFF_THRESHOLD, NULL, eye_detector.is_running() ? &eye_detector : NULL);
+	}
+
+	//Recorder loop - same as FishTestCamera::_record_video(), minus the preview
+	cv::Mat image;
+	std::vector<uchar> jpeg;
+	FrameInfo info;
+	info.index = 0;
+	info.sequence = 0;
+
+	uint64_t cursor = 0;
+	uint64_t frames_read = 0;
+	uint64_t ring_dropped = 0;
+	uint64_t source_skipped = 0;
+	bool stalled = false;
+
+	//LED state frames were tagged with, and neighbouring frames that didn't go lit/unlit/lit...
+	uint64_t lit_frames = 0;
+	uint64_t unlit_frames = 0;
+	uint64_t switched_frames = 0;
+	uint64_t not_alternating = 0;
+	info.led_state = 0;
+
+	while (cv::getTickCount() / cv::getTickFrequency() - start_time < config.seconds)
+	{
+		if (ring.wait(cursor, BENCH_WAIT_TIMEOUT) == false)
+		{
+			stalled = true;
+			break;
+		}
+
+		uint64_t prev_index = info.index;
+		uint32_t prev_sequence = info.sequence;
+		int prev_led_state = info.led_state;
+
+		while (ring.compressed() ? ring.read_compressed(cursor, jpeg, info) : ring.read(cursor, image, info))
+		{
+			//Recorder too slow to pick frames up before the ring overwrote them
+			ring_dropped += info.index - prev_index - 1;
+
+			//Source lost frames before they reached the ring
+			if (frames_read > 0 && info.sequence - prev_sequence > info.index - prev_index)
+			{
+				source_skipped += info.sequence - prev_sequence - (info.index - prev_index);
+			}
+
+			if (strobe)
+			{
+				lit_frames += (info.led_state == 1) ? 1 : 0;
+				unlit_frames += (info.led_state == 0) ? 1 : 0;
+				switched_frames += (info.led_state < 0) ? 1 : 0;
+
+				//Only frames straight after each other can be checked, a lost frame breaks the pattern without anything being wrong
+				bool consecutive = frames_read > 0 && info.index == prev_index + 1 && info.sequence == prev_sequence + 1;
+
+				if (consecutive && (info.led_state < 0 || info.led_state == prev_led_state))
+				{
+					not_alternating++;
+				}
+			}
+
+			if (ring.compressed())
+			{
+				encoder.push_compressed(jpeg, info);
+			}
+			else
+			{
+				encoder.push(image, info);
+			}
+			frames_read++;
+
+			prev_index = info.index;
+			prev_sequence = info.sequence;
+			prev_led_state = info.led_state;
+		}
+	}
+
+	running = false;
+	capture_thread.join();
+	flash_difference.stop();
+	eye_detector.stop();
+
+	//Everything queued is written before the clock stops
+	encoder.close();
+
+	double run_time = cv::getTickCount() / cv::getTickFrequency() - start_time;
+
+	double user_end, system_end;
+	cpu_time(user_end, system_end);
+
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	const LatencyHistogram &latency = encoder.latency_histogram();
+
+	double cpu_seconds = (user_end - user_start) + (system_end - system_start);
+
+	std::stringstream json_ss;
+	json_ss << "{\n";
+	json_ss << "  \"width\": " << source.size().width << ",\n";
+	json_ss << "  \"height\": " << source.size().height << ",\n";
+	json_ss << "  \"target_fps\": " << config.fps << ",\n";
+	json_ss << "  \"jitter_ms\": " << config.jitter_ms << ",\n";
+	json_ss << "  \"codec\": \"" << (encoder.raw() ? "raw" : (encoder.passthrough() ? "MJPG" : config.codec)) << "\",\n";
+	json_ss << "  \"passthrough\": " << (encoder.passthrough() ? "true" : "false") << ",\n";
+	json_ss << "  \"seconds\": " << run_time << ",\n";
+	json_ss << "  \"stalled\": " << (stalled ? "true" : "false") << ",\n";
+	json_ss << "  \"frames_captured\": " << ring.head() << ",\n";
+	json_ss << "  \"frames_written\": " << encoder.frames_written() << ",\n";
+	json_ss << "  \"sustained_fps\": " << (run_time > 0 ? encoder.frames_written() / run_time : 0) << ",\n";
+	json_ss << "  \"latency_ms\": { \"p50\": " << latency.percentile(0.5) << ", \"p99\": " << latency.percentile(0.99) << ", \"max\": " << latency.max() << " },\n";
+	if (strobe)
+	{
+		json_ss << "  \"led_states\": { \"lit\": " << lit_frames << ", \"unlit\": " << unlit_frames << ", \"switched\": " << switched_frames << ", \"not_alternating\": " << not_alternating << " },\n";
+	}
+	if (config.diff)
+	{
+		const LatencyHistogram &diff_time = flash_difference.compute_histogram();
+		json_ss << "  \"flash_difference\": { \"pairs\": " << flash_difference.pairs() << ", \"switched_frames\": " << flash_difference.frames_switched() << ", \"unpaired_frames\": " << flash_difference.frames_unpaired() << ", \"p50_ms\": " << diff_time.percentile(0.5) << ", \"p99_ms\": " << diff_time.percentile(0.99) << ", \"max_ms\": " << diff_time.max() << " },\n";
+
+		const LatencyHistogram &eye_time = eye_detector.process_histogram();
+		json_ss << "  \"eye_detector\": { \"frames\": " << eye_detector.frames_analysed() << ", \"skipped\": " << eye_detector.frames_skipped() << ", \"detections\": " << eye_detector.detections() << ", \"p50_ms\": " << eye_time.percentile(0.5) << ", \"p99_ms\": " << eye_time.percentile(0.99) << ", \"max_ms\": " << eye_time.max() << " },\n";
+	}
+	json_ss << "  \"dropped_frames\": { \"ring\": " << ring_dropped << ", \"encoder\": " << encoder.frames_dropped() << ", \"source\": " << source_skipped << " },\n";
+	json_ss << "  \"cpu_seconds\": { \"user\": " << user_end - user_start << ", \"system\": " << system_end - system_start << " },\n";
+	json_ss << "  \"cpu_percent\": " << (run_time > 0 ? 100 * cpu_seconds / run_time : 0) << ",\n";
+	json_ss << "  \"peak_rss_kb\": " << usage.ru_maxrss << "\n";
+	json_ss << "}\n";
+
+	std::cout << json_ss.str();
+
+	source.close();
+
+	//Strobed frames have to come out lit, unlit, lit... at this exposure, or the recorder's split and difference get nothing
+	if (config.strobe_check && (switched_frames > 0 || not_alternating > 0 || lit_frames == 0 || unlit_frames == 0))
+	{
+		std::cerr << "Strobe check failed: " << switched_frames << " frames exposed across an LED switch, " << not_alternating << " not alternating\n";
+		return -1;
+	}
+
+	return stalled ? -1 : 0;
+}
+
+bool parse_args(int argc, char **argv, BenchConfig &config)
+{
+	config.size = cv::Size(BENCH_WIDTH_DEFAULT, BENCH_HEIGHT_DEFAULT);
+	config.fps = BENCH_FPS_DEFAULT;
+	config.jitter_ms = 0;
+	config.seconds = BENCH_SECONDS_DEFAULT;
+	config.exposure_ms = BENCH_EXPOSURE_DEFAULT;
+	config.codec = BENCH_CODEC_DEFAULT;
+	config.output = BENCH_OUTPUT_DEFAULT;
+	config.sidecar = BENCH_SIDECAR_DEFAULT;
+	config.mjpeg = false;
+	config.raw = false;
+	config.diff = false;
+	config.strobe_check = false;
+
+	int arg_ind = 1;
+
+	while (arg_ind < argc)
+	{
+		std::string option = argv[arg_ind];
+		int args_left = argc - arg_ind - 1;
+
+		if (option == "--size" && args_left >= 2)
+		{
+			config.size = cv::Size(atoi(argv[arg_ind + 1]), atoi(argv[arg_ind + 2]));
+			arg_ind += 3;
+		}
+
+		else if (option == "--fps" && args_left >= 1)
+		{
+			config.fps = atof(argv[arg_ind + 1]);
+			arg_ind += 2;
+		}
+
+		else if (option == "--jitter" && args_left >= 1)
+		{
+			config.jitter_ms = atof(argv[arg_ind + 1]);
+			arg_ind += 2;
+		}
+
+		else if (option == "--codec" && args_left >= 1)
+		{
+			config.codec = argv[arg_ind + 1];
+			arg_ind += 2;
+		}
+
+		else if (option == "--seconds" && args_left >= 1)
+		{
+			config.seconds = atof(argv[arg_ind + 1]);
+			arg_ind += 2;
+		}
+
+		else if (option == "--exposure" && args_left >= 1)
+		{
+			config.exposure_ms = atof(argv[arg_ind + 1]);
+			arg_ind += 2;
+		}
+
+		else if (option == "--output" && args_left >= 1)
+		{
+			config.output = argv[arg_ind + 1];
+			arg_ind += 2;
+		}
+
+		else if (option == "--sidecar" && args_left >= 1)
+		{
+			config.sidecar = argv[arg_ind + 1];
+			arg_ind += 2;
+
+			if (config.sidecar == "none")
+			{
+				config.sidecar = "";
+			}
+		}
+
+		//Source hands out JPEGs like the camera in MJPEG mode, recorded without re-encoding
+		else if (option == "--mjpeg")
+		{
+			config.mjpeg = true;
+			arg_ind += 1;
+		}
+
+		//Uncompressed frames into a preallocated, memory-mapped file
+		else if (option == "--raw")
+		{
+			config.raw = true;
+			arg_ind += 1;
+
+			if (config.output == BENCH_OUTPUT_DEFAULT)
+			{
+				config.output = BENCH_RAW_OUTPUT_DEFAULT;
+			}
+		}
+
+		//Strobed frames are differenced against their neighbour
+		else if (option == "--diff")
+		{
+			config.diff = true;
+			arg_ind += 1;
+		}
+
+		//Fails (exit code -1) unless strobed frames are tagged lit and unlit alternately, i.e. none are exposed across an LED switch
+		else if (option == "--strobe-check")
+		{
+			config.strobe_check = true;
+			arg_ind += 1;
+		}
+
+		else
+		{
+			return false;
+		}
+	}
+
+	return config.size.area() > 0 && config.fps > 0 && config.jitter_ms >= 0 && config.exposure_ms >= 0 && config.seconds > 0 && config.codec.size() == 4;
+}
+
+void capture_frames(FrameSource *source, FrameRing *ring, std::atomic<bool> *running, bool strobe)
+{
+	SourceFrame frame;
+	FrameInfo info;
+	info.led_state = 0;
+	info.controls = FrameControls();
+
+	StrobeState strobe_state;
+	strobe_reset(strobe_state);
+
+	while (*running)
+	{
+		if (source->grab(frame, BENCH_POLL_TIMEOUT) == false)
+		{
+			continue;
+		}
+
+		info.timestamp = frame.timestamp;
+		info.sequence = frame.sequence;
+		info.exposure_start = frame.exposure_start;
+		info.exposure_end = frame.exposure_end;
+
+		//Tag with what the LEDs did during the exposure, then switch them for the next frame, like FishTestCamera::_capture_frames()
+		if (strobe)
+		{
+			info.led_state = strobe_state_during(strobe_state, frame.exposure_start, frame.exposure_end);
+			strobe_switched(strobe_state, !strobe_state.level, cv::getTickCount() / cv::getTickFrequency());
+		}
+
+		//Compressed frames go into the ring as they are, like the camera's
+		if (ring->compressed())
+		{
+			ring->publish_compressed(frame.image.data, frame.image.total(), info);
+		}
+		else if (source->convert(frame, ring->write_slot()))
+		{
+			ring->publish(info);
+		}
+
+		source->release(frame);
+	}
+}
+
+void cpu_time(double &user, double &system)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1000000.0;
+	system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1000000.0;
+}
@@ -4,8 +4,6 @@
  * @author OpenCV team
  */
 
-#include <pigpio.h>
-
 #include <iostream>
 
 #include <stdio.h>
@@ -20,6 +18,9 @@
 #include "cvui.h"
 
 #include "FishTestCamera.h"
+#include "FileFrameSource.h"
+#include "SyntheticFrameSource.h"
+#include "SimulatedGpio.h"
 
 #define BUTTON_1_PIN	27 // pin for button
 #define BUTTON_2_PIN	25 // pin for button
@@ -29,18 +30,33 @@
 #define SUCCESS_LED_PIN	22 // pin for flashing led
 	
 #define DEBOUNCE_INTERVAL			10000	// microseconds
-#define DEBOUNCE_INTERVAL_VID_S		1		//seconds
-#define DEBOUNCE_INTERVAL_VID_US	250000	// microseconds
+#define DEBOUNCE_INTERVAL_VID		1250000	// microseconds
+#define GLITCH_FILTER				2000	// microseconds pin must be steady before an edge is reported
 
 #define ISR_TIMEOUT		100000 // microseconds
 
+#define REPLAY_FPS_DEFAULT	30.0	// frame rate of replayed footage if not given
+#define SIM_PRESS_HOLD		0.1		// seconds a simulated button is held down
+
 //Holds camera object for taking picture, saving to file, doing some processing
 FishTestCamera cam(FLASH_LEDS_PIN, VIDEO_LED_PIN, SUCCESS_LED_PIN, BUTTON_1_PIN, BUTTON_2_PIN);
+
+//Set when running without a Pi, owned by cam
+SimulatedGpio *sim_gpio = NULL;
+
+//Where simulated pin transitions get written on exit
+std::string sim_trace_path;
+
+//Simulated button presses, pin and seconds after start
+std::vector<std::pair<int, double> > sim_presses;
 	
 //////////FUNCTION PROTOTYPES///////////
 //Initializes button ISRs
 void init();
 
+//Picks frame source and GPIO backend from command line, returns false if arguments don't make sense
+bool init_args(int argc, char **argv);
+
 //Debounces and invokes camera object ISR 1 if pressed
 void button_1_isr(int gpio, int level, uint32_t tick);
 
@@ -48,8 +64,16 @@ void button_1_isr(int gpio, int level, uint32_t tick);
 void button_2_isr(int gpio, int level, uint32_t tick);
 
 //////////FUNCTION DEFINITIONS///////////
-int main()
+int main(int argc, char **argv)
 {
+	//Use recorded or synthetic frames, or simulated GPIO, if asked to
+	if (init_args(argc, argv) == false)
+	{
+		std::cout << "Usage: " << argv[0] << " [--replay <video or folder of jpgs> [fps]] [--synthetic <width> <height> <fps> [jitter ms]]"
+			<< " [--sim-gpio <trace.csv> [--press <1|2> <seconds>]...] [--raw] [--diff-video]\n";
+		return -1;
+	}
+	
 	//Initialize variables, pins, etc.
 	if (cam.init() < 0)
 	{
@@ -60,6 +84,16 @@ int main()
 	//Initializes buttons
 	init();
 	
+	//Buttons only have callbacks once init() has run
+	if (sim_gpio != NULL)
+	{
+		for (size_t press_ind = 0; press_ind < sim_presses.size(); press_ind++)
+		{
+			sim_gpio->inject_edge(sim_presses[press_ind].first, 0, sim_presses[press_ind].second);
+			sim_gpio->inject_edge(sim_presses[press_ind].first, 1, sim_presses[press_ind].second + SIM_PRESS_HOLD);
+		}
+	}
+	
 	//Continuous program loop
 	while (1)
 	{
@@ -71,43 +105,182 @@ int main()
 			break;
 		}
 	}
+	
+	//Every LED, strobe and button transition, for checking timing without a scope
+	if (sim_gpio != NULL && sim_gpio->write_trace(sim_trace_path) == false)
+	{
+		std::cout << "Couldn't write GPIO trace to " << sim_trace_path << "\n";
+	}
+}
+
+bool init_args(int argc, char **argv)
+{
+	int arg_ind = 1;
+	
+	while (arg_ind < argc)
+	{
+		std::string mode = argv[arg_ind];
+		int args_left = argc - arg_ind - 1;
+		
+		//Recorded video, or folder of pictures
+		if (mode == "--replay" && args_left >= 1)
+		{
+			std::string path = argv[arg_ind + 1];
+			double fps = REPLAY_FPS_DEFAULT;
+			arg_ind += 2;
+			
+			//Frame rate is optional
+			if (args_left >= 2 && argv[arg_ind][0] != '-')
+			{
+				fps = atof(argv[arg_ind]);
+				arg_ind++;
+			}
+			
+			if (fps <= 0)
+			{
+				return false;
+			}
+			
+			cam.set_frame_source(new FileFrameSource(path, fps));
+		}
+		
+		//Generated frames at any size, rate and jitter
+		else if (mode == "--synthetic" && args_left >= 3)
+		{
+			cv::Size size(atoi(argv[arg_ind + 1]), atoi(argv[arg_ind + 2]));
+			double fps = atof(argv[arg_ind + 3]);
+			double jitter_ms = 0;
+			arg_ind += 4;
+			
+			//Jitter is optional
+			if (args_left >= 4 && argv[arg_ind][0] != '-')
+			{
+				jitter_ms = atof(argv[arg_ind]);
+				arg_ind++;
+			}
+			
+			if (fps <= 0)
+			{
+				return false;
+			}
+			
+			cam.set_frame_source(new SyntheticFrameSource(fps, jitter_ms), size);
+		}
+		
+		//No Pi needed, pin transitions are logged to a file instead
+		else if (mode == "--sim-gpio" && args_left >= 1)
+		{
+			if (sim_gpio == NULL)
+			{
+				sim_gpio = new SimulatedGpio();
+				cam.set_gpio_backend(sim_gpio);
+			}
+			
+			sim_trace_path = argv[arg_ind + 1];
+			arg_ind += 2;
+		}
+		
+		//Button press on simulated GPIO
+		else if (mode == "--press" && args_left >= 2)
+		{
+			int button = atoi(argv[arg_ind + 1]);
+			
+			if (button != 1 && button != 2)
+			{
+				return false;
+			}
+			
+			sim_presses.push_back(std::make_pair(button == 1 ? BUTTON_1_PIN : BUTTON_2_PIN, atof(argv[arg_ind + 2])));
+			arg_ind += 3;
+		}
+		
+		//Lossless videos and pictures for analysis
+		else if (mode == "--raw")
+		{
+			cam.set_raw_recording(true);
+			arg_ind++;
+		}
+		
+		//Flash-minus-ambient difference of strobed videos as a third file
+		else if (mode == "--diff-video")
+		{
+			cam.set_difference_video(true);
+			arg_ind++;
+		}
+		
+		else
+		{
+			return false;
+		}
+	}
+	
+	//Presses need something to inject them into
+	return sim_presses.empty() || sim_gpio != NULL;
 }
 
 void init()
 {
 	//Button 1 setup
-	gpioSetMode(BUTTON_1_PIN, PI_INPUT);
-	gpioSetPullUpDown(BUTTON_1_PIN, PI_PUD_UP);
+	cam.gpio()->set_mode(BUTTON_1_PIN, GPIO_INPUT);
+	cam.gpio()->set_pull(BUTTON_1_PIN, GPIO_PUD_UP);
+		
+	//Ignore noise on the line without ever sleeping in the callback
+	cam.gpio()->set_glitch_filter(BUTTON_1_PIN, GLITCH_FILTER);
 		
 	//Setup ISR with Button 1 
-	gpioSetISRFunc(BUTTON_1_PIN, FALLING_EDGE, ISR_TIMEOUT, button_1_isr);	
+	cam.gpio()->set_edge_callback(BUTTON_1_PIN, GPIO_FALLING_EDGE, ISR_TIMEOUT, button_1_isr);	
 
 	//Button 2 setup
-	gpioSetMode(BUTTON_2_PIN, PI_INPUT);
-	gpioSetPullUpDown(BUTTON_2_PIN, PI_PUD_UP);
+	cam.gpio()->set_mode(BUTTON_2_PIN, GPIO_INPUT);
+	cam.gpio()->set_pull(BUTTON_2_PIN, GPIO_PUD_UP);
+	
+	//Ignore noise on the line without ever sleeping in the callback
+	cam.gpio()->set_glitch_filter(BUTTON_2_PIN, GLITCH_FILTER);
 	
 	//Setup ISR with Button 2 
-	gpioSetISRFunc(BUTTON_2_PIN, FALLING_EDGE, ISR_TIMEOUT, button_2_isr);
+	cam.gpio()->set_edge_callback(BUTTON_2_PIN, GPIO_FALLING_EDGE, ISR_TIMEOUT, button_2_isr);
 }
 
 //Button 1 ISR - Debounces, invokes camera ISR 1 when pressed
 void button_1_isr(int gpio, int level, uint32_t tick)
 {
-	gpioSleep(PI_TIME_RELATIVE, 0, DEBOUNCE_INTERVAL);	
+	//Tick of last press that got through, only touched by this callback's thread
+	static uint32_t last_tick = 0;
+	
+	//Only falling edges, not watchdog timeouts
+	if (level != 0)
+	{
+		return;
+	}
 	
-	if (gpioRead(BUTTON_1_PIN) == false)
+	//Bounce from a press we already took, tick wraps so compare the difference
+	if (tick - last_tick < DEBOUNCE_INTERVAL)
 	{
-		cam.set_button_1();
+		return;
 	}
+	last_tick = tick;
+	
+	cam.set_button_1(tick);
 }
 
 //Button 2 ISR - Debounces, invokes camera ISR 2 when pressed
 void button_2_isr(int gpio, int level, uint32_t tick)
 {
-	gpioSleep(PI_TIME_RELATIVE, DEBOUNCE_INTERVAL_VID_S, DEBOUNCE_INTERVAL_VID_US);	
+	//Tick of last press that got through, only touched by this callback's thread
+	static uint32_t last_tick = 0;
 	
-	if (gpioRead(BUTTON_2_PIN) == false)
+	//Only falling edges, not watchdog timeouts
+	if (level != 0)
 	{
-		cam.set_button_2();		
+		return;
 	}
+	
+	//Long debounce so one press can't start and then stop a video, tick wraps so compare the difference
+	if (tick - last_tick < DEBOUNCE_INTERVAL_VID)
+	{
+		return;
+	}
+	last_tick = tick;
+	
+	cam.set_button_2(tick);		
 }
\ No newline at end of file